@@ -0,0 +1,122 @@
+/*
+ * Sample Main Program
+ *  Snapshot and restore. (using mruby/c scheduler)
+ *
+ *  Ruby method 'snapshot' saves the runtime to memory. When all tasks
+ *  have finished, the runtime is restored from it, and the tasks run
+ *  again from the point of 'snapshot'.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mrubyc.h"
+#include "snapshot.h"
+
+#define MEMORY_SIZE (1024*30)
+static uint8_t memory_pool[MEMORY_SIZE];
+
+#define SNAPSHOT_SIZE (MEMORY_SIZE + 1024*4)
+static uint8_t *snapshot_buf;
+static unsigned int snapshot_len;
+
+uint8_t * load_mrb_file(const char *filename)
+{
+  FILE *fp = fopen(filename, "rb");
+
+  if( fp == NULL ) {
+    fprintf(stderr, "File not found\n");
+    return NULL;
+  }
+
+  // get filesize
+  fseek(fp, 0, SEEK_END);
+  size_t size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+
+  // allocate memory
+  uint8_t *p = malloc(size);
+  if( p == NULL ) {
+    fprintf(stderr, "Memory allocate error.\n");
+    return NULL;
+  }
+  fread(p, sizeof(uint8_t), size, fp);
+  fclose(fp);
+
+  return p;
+}
+
+
+// write to snapshot_buf
+static int write_mem(void *ptr, unsigned int size, void *arg)
+{
+  unsigned int *pos = (unsigned int *)arg;
+  if( *pos + size > SNAPSHOT_SIZE ) return -1;
+
+  memcpy(snapshot_buf + *pos, ptr, size);
+  *pos += size;
+  return 0;
+}
+
+
+// read from snapshot_buf
+static int read_mem(void *ptr, unsigned int size, void *arg)
+{
+  unsigned int *pos = (unsigned int *)arg;
+  if( *pos + size > snapshot_len ) return -1;
+
+  memcpy(ptr, snapshot_buf + *pos, size);
+  *pos += size;
+  return 0;
+}
+
+
+// Ruby method: snapshot
+static void c_snapshot(mrb_vm *vm, mrb_value *v)
+{
+  unsigned int pos = 0;
+
+  if( snapshot_buf == NULL ) snapshot_buf = malloc(SNAPSHOT_SIZE);
+  if( snapshot_buf == NULL || mrbc_snapshot_save(write_mem, &pos) != 0 ) {
+    printf("snapshot: can't save\n");
+    return;
+  }
+  snapshot_len = pos;
+}
+
+
+int main(int argc, char *argv[])
+{
+  int vm_cnt = argc-1;
+  if( vm_cnt < 1 || vm_cnt > 10 ){
+    printf("Usage: %s <xxxx.mrb> <xxxx.mrb> ... \n", argv[0]);
+    return 1;
+  }
+
+  mrbc_init(memory_pool, MEMORY_SIZE);
+  mrbc_define_method(0, mrbc_class_object, "snapshot", c_snapshot);
+
+  const uint8_t *code[10];
+  int i;
+  for( i=0 ; i<vm_cnt ; i++ ){
+    uint8_t *p = load_mrb_file( argv[i+1] );
+    if( p == NULL ) return 1;
+
+    code[i] = p;
+    if( mrbc_create_task( p, 0 ) == NULL ) return 1;
+  }
+  mrbc_run();
+
+  if( snapshot_len == 0 ) return 0;
+
+  // restore to the initialized runtime, and run again.
+  unsigned int pos = 0;
+  mrbc_init(memory_pool, MEMORY_SIZE);
+  int ret = mrbc_snapshot_restore(read_mem, &pos, code, vm_cnt);
+  printf("restore: %d\n", ret);
+  fflush(stdout);
+  if( ret != 0 ) return 1;
+  mrbc_run();
+
+  return 0;
+}
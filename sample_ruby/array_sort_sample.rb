@@ -0,0 +1,35 @@
+# Array test for following methods:
+#   sort
+#   sort!
+#   sort_by
+#   min
+#   max
+#   include?
+#   bsearch
+
+a = [5,3,9,1,7]
+
+b = a.sort
+puts b[0]
+puts b[4]
+
+b = a.sort { |x, y| y <=> x }
+puts b[0]
+puts b[4]
+
+b = a.sort_by { |x| x % 3 }
+puts b[0]
+puts b[4]
+
+puts a.min
+puts a.max
+puts a.include?(7)
+puts a.include?(4)
+
+a.sort!
+puts a[0]
+puts a.bsearch { |x| x >= 4 }
+
+f = [2.5, 0.5, 1.5]
+puts f.sort[0]
+puts f.max
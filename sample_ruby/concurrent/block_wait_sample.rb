@@ -0,0 +1,31 @@
+# sleep and join in a block of each
+#  each, map and so on call the block from C, so the task can't be
+#  switched in it. sleep, join and other waits are refused there with
+#  ThreadError, and return nil without waiting.
+#  use while loop to wait in a loop.
+#  prints ThreadError four times, then 0 and 2.
+
+$done = 0
+
+t1 = Task.new do
+  sleep_ms 10
+  $done += 1
+end
+
+t2 = Task.new do
+  sleep_ms 20
+  $done += 1
+end
+
+tasks = [t1, t2]
+
+[1, 2].each { |x| sleep_ms 100 }
+tasks.each { |t| t.join }
+puts $done
+
+i = 0
+while i < tasks.size do
+  tasks[i].join
+  i += 1
+end
+puts $done
@@ -0,0 +1,25 @@
+# CPU budget, priority is restored in each budget period.
+#  run with budget_restore_2.rb, on hal_virtual (see doc/compile.md).
+#    mrubyc_concurrent budget_restore_1.mrb budget_restore_2.mrb
+#
+#  this task never yields, and is allowed 20ms per 100ms.
+#  it gets back its priority at 100, so budget_restore_2.rb which
+#  wakes up at 110 has to wait until the budget runs out again.
+#  expected output (+/- a few ticks):
+#    stopped 120
+#    resumed 200
+#    stopped 220
+#    resumed 300
+
+change_priority(1)
+set_budget(20, 100, :demote)
+
+t = get_tick
+while t < 300 do
+  t2 = get_tick
+  if t2 - t > 5
+    puts "stopped #{t}"
+    puts "resumed #{t2}"
+  end
+  t = t2
+end
@@ -0,0 +1,9 @@
+# CPU bound task, with lower priority than budget_restore_1.rb.
+#  first runs at 20 when the other task is demoted, and wakes up
+#  at 110.
+
+change_priority(10)
+sleep_ms(90)
+
+while get_tick < 300 do
+end
@@ -0,0 +1,9 @@
+# CPU budget
+#  high priority task which never yields.
+#  allowed 20ms per 100ms, then demoted to lowest priority.
+
+change_priority(1)
+set_budget(20, 100, :demote)
+
+while true do
+end
@@ -0,0 +1,15 @@
+# EDF task
+#  period 10ms, relative deadline 5ms, worst execution time 1000us.
+
+if !set_edf(10, 5, 1000)
+  puts "rejected by admission check"
+end
+
+i = 0
+while i < 100 do
+  # do control work here.
+  wait_period
+  i += 1
+end
+
+puts deadline_miss
@@ -0,0 +1,14 @@
+# periodic task
+#  release every 10ms without cumulative drift.
+
+set_period(10)
+t0 = get_tick
+
+i = 0
+while i < 10 do
+  puts get_tick - t0
+  if !wait_period
+    puts "deadline missed"
+  end
+  i += 1
+end
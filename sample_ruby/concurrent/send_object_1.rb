@@ -0,0 +1,4 @@
+# producer
+buf = [1, 2, 3, "data"]
+$buf = send_object(buf)
+$ready = 1
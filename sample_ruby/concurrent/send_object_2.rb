@@ -0,0 +1,6 @@
+# consumer
+until $ready == 1 do
+end
+buf = receive_object($buf)
+puts buf.size
+puts buf[3]
@@ -0,0 +1,28 @@
+# Task.new, join and cancel
+#  blocks can not refer outer local variables. use globals to pass data.
+
+$count = 0
+
+t1 = Task.new do
+  i = 0
+  while i < 3 do
+    puts "child"
+    $count += 1
+    sleep_ms 5
+    i += 1
+  end
+end
+
+t1.join
+puts $count
+
+t2 = Task.new do
+  while true do
+    relinquish
+  end
+end
+
+sleep_ms 20
+t2.cancel
+t2.join
+puts t2.alive?
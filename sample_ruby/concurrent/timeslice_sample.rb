@@ -0,0 +1,15 @@
+# time slice
+#  batch task: long time slice, adapted by scheduler.
+
+adaptive_timeslice(true)
+
+sum = 0
+i = 0
+while i < 100000 do
+  sum += i
+  i += 1
+end
+puts sum
+
+# fixed time slice. 5ms
+set_timeslice(5)
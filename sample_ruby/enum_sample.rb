@@ -0,0 +1,40 @@
+# Enumerable test for following methods:
+#   each
+#   each_with_index
+#   map
+#   select
+#   reject
+#   reduce / inject
+#   sum
+#   count
+
+a = [1,2,3,4,5]
+
+b = a.map { |x| x * 2 }
+puts b[4]
+
+b = a.select { |x| x % 2 == 1 }
+puts b.size
+
+b = a.reject { |x| x % 2 == 1 }
+puts b.size
+
+puts a.reduce { |s, x| s + x }
+puts a.inject(100) { |s, x| s + x }
+
+a.each_with_index { |x, i| puts x * 10 + i }
+
+puts a.sum
+puts a.sum { |x| x * 2 }
+puts a.count
+puts a.count(4)
+puts a.count { |x| x % 2 == 1 }
+
+r = 1..100
+puts r.sum
+puts r.count { |x| x % 2 == 1 }
+(1...4).each { |x| puts x }
+
+h = {1=>1, 2=>2, 3=>3}
+h.each { |k, v| puts k * 10 + v }
+puts h.select { |k, v| v > 1 }.count
@@ -0,0 +1,10 @@
+TABLE = [10, 20, 30, "calibration"].freeze
+
+puts TABLE.frozen?
+puts TABLE[3]
+
+TABLE[0] = 0
+puts TABLE[0]
+
+a = [1, 2]
+puts a.frozen?
@@ -0,0 +1,42 @@
+# Hash test for following methods:
+#   []=
+#   delete
+#   key?
+#   keys
+#   values
+#   each
+
+h = {3=>30, 1=>10, 2=>20}
+h[1] = 11
+h[4] = 40
+
+puts h.delete(3)
+puts h.key?(3)
+h[3] = 33
+
+k = h.keys
+puts k[0]
+puts k[3]
+
+v = h.values
+puts v[0]
+puts v[3]
+
+puts h.size
+h.each { |key, val| puts key * 100 + val }
+
+# insert and delete a new key repeatedly, on a hash with index table.
+h = {}
+i = 0
+while i < 9 do
+  h[i] = i
+  i += 1
+end
+while i < 200 do
+  h[i] = i
+  h.delete(i)
+  i += 1
+end
+puts h.size
+puts h[8]
+puts h[100]
@@ -0,0 +1,15 @@
+# JSON test for following methods:
+#   JSON.generate
+#   JSON.parse
+
+data = {"id"=>1, "temp"=>23.5, "tags"=>["a", "b"], "ok"=>true, "none"=>nil}
+s = JSON.generate(data)
+puts s
+
+h = JSON.parse(s)
+puts h["temp"]
+puts h["tags"][1]
+
+a = JSON.parse('[1, -2, 3.5e2, "x\ty", {"k": []}]')
+puts a.size
+puts a[2]
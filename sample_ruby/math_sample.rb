@@ -0,0 +1,20 @@
+# Math test for following methods:
+#   Math.sqrt
+#   Math.atan2
+#   Math.log
+#   Math.sqrt_all
+#   Math.hypot_all
+# needs MRBC_USE_MATH, see doc/compile.md
+
+puts Math.sqrt(2)
+puts Math.atan2(1.0, 1)
+puts Math.log(8, 2)
+
+a = [1, 4, 9.0, 16]
+Math.sqrt_all(a)
+puts a[3]
+
+xs = [3, 5]
+ys = [4, 12]
+Math.hypot_all(xs, ys)
+puts xs[1]
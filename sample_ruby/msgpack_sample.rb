@@ -0,0 +1,29 @@
+# MessagePack test for following methods:
+#   MessagePack.pack
+#   MessagePack.unpack
+#   MessagePackBuffer.new, MessagePackBuffer#size, #[], #<<, #clear
+
+data = {"id"=>1, "temp"=>23.5, "tags"=>[:a, :b], "ok"=>true, "none"=>nil}
+bytes = MessagePack.pack(data)
+puts bytes.size
+
+h = MessagePack.unpack(bytes)
+puts h["temp"]
+puts h["tags"][1]
+
+a = MessagePack.unpack([0x93, 0x01, 0xd0, 0xfe, 0xa1, 0x78])
+puts a.size
+puts a[1]
+
+# pack into a buffer of 64 bytes, and unpack from it.
+buf = MessagePackBuffer.new(64)
+MessagePack.pack(data, buf)
+puts buf.size
+puts buf[0]
+h = MessagePack.unpack(buf)
+puts h["id"]
+
+# fill the buffer byte by byte, e.g. from a serial port.
+buf.clear
+[0x92, 0x01, 0x02].each { |b| buf << b }
+puts MessagePack.unpack(buf).size
@@ -0,0 +1,13 @@
+# snapshot and restore
+#  run with sample_c/mrubyc_snapshot.
+#  'snapshot' saves the runtime at i == 2. after the program ends,
+#  the runtime is restored and runs again from there.
+#  prints start, 1, 2, 3, then 2, 3 after "restore: 0".
+
+puts "start"
+i = 1
+while i <= 3 do
+  snapshot if i == 2
+  puts i
+  i += 1
+end
@@ -0,0 +1,13 @@
+# String formatting test for following methods:
+#   sprintf
+#   format
+#   %
+#   interpolation
+
+puts sprintf("[%08d|%-5s|%5s|%x|%b|%%]", -123, "ab", "xyz", 255, 5)
+puts format("v=%05.2f %s", 1.5, :sym)
+puts "%d-%d" % [1, 2]
+
+n = -5
+f = 1.5
+puts "n=#{n} f=#{f} s=#{:sym}"
@@ -0,0 +1,29 @@
+# String test for following methods:
+#   index
+#   include?
+#   start_with?
+#   end_with?
+#   count
+#   split
+#   strip
+#   ==
+
+s = "hello world hello"
+
+puts s.index("llo")
+puts s.index("llo", 5)
+puts s.include?("world")
+puts s.start_with?("hello")
+puts s.end_with?("world")
+puts s.count("lo")
+puts s == "hello world hello"
+
+a = "  a  b\tc  ".split
+puts a.size
+puts a[2]
+
+a = "a,b,,c,,".split(",")
+puts a.size
+puts a[3]
+
+puts "  pad \n".strip
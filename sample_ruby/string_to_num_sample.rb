@@ -0,0 +1,13 @@
+# String to number conversion test for following methods:
+#   to_i
+#   to_f
+#   Integer
+
+puts "  -ff".to_i(16)
+puts "0b101".to_i(2)
+puts "1_000".to_i
+puts "3.25e2".to_f
+puts "-0.125,1.5".to_f
+puts Integer("0x1f")
+puts Integer("010")
+puts Integer(" 42 ")
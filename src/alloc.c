@@ -19,6 +19,7 @@
 
 #include "alloc.h"
 #include "console.h"
+#include "snapshot.h"
 
 
 // Layer 1st(f) and 2nd(s) model
@@ -62,6 +63,8 @@
 typedef struct USED_BLOCK {
   unsigned int         t : 1;       //!< FLAG_TAIL_BLOCK or FLAG_NOT_TAIL_BLOCK
   unsigned int         f : 1;       //!< FLAG_FREE_BLOCK or BLOCK_IS_NOT_FREE
+  unsigned int         frozen : 1;  //!< frozen object, read only
+  unsigned int         tt : 5;      //!< object type tag (mrb_vtype), 0 unknown
   uint8_t              vm_id;       //!< mruby/c VM ID
   MRBC_ALLOC_MEMSIZE_T size;        //!< block size, header included
   MRBC_ALLOC_MEMSIZE_T prev_offset; //!< offset of previous physical block
@@ -70,6 +73,8 @@ typedef struct USED_BLOCK {
 typedef struct FREE_BLOCK {
   unsigned int         t : 1;       //!< FLAG_TAIL_BLOCK or FLAG_NOT_TAIL_BLOCK
   unsigned int         f : 1;       //!< FLAG_FREE_BLOCK or BLOCK_IS_NOT_FREE
+  unsigned int         frozen : 1;  //!< dummy
+  unsigned int         tt : 5;      //!< dummy
   uint8_t              vm_id;       //!< dummy
   MRBC_ALLOC_MEMSIZE_T size;        //!< block size, header included
   MRBC_ALLOC_MEMSIZE_T prev_offset; //!< offset of previous physical block
@@ -86,6 +91,12 @@ typedef struct FREE_BLOCK {
   (((USED_BLOCK *)((uint8_t *)(p) - sizeof(USED_BLOCK)))->vm_id = (id))
 #define GET_VM_ID(p) \
   (((USED_BLOCK *)((uint8_t *)(p) - sizeof(USED_BLOCK)))->vm_id)
+#define SET_TT(p,tt_) \
+  (((USED_BLOCK *)((uint8_t *)(p) - sizeof(USED_BLOCK)))->tt = (tt_))
+#define GET_TT(p) \
+  (((USED_BLOCK *)((uint8_t *)(p) - sizeof(USED_BLOCK)))->tt)
+#define BLOCK_HEADER(p) \
+  ((USED_BLOCK *)((uint8_t *)(p) - sizeof(USED_BLOCK)))
 
 
 // memory pool
@@ -284,6 +295,11 @@ void mrbc_init_alloc(void *ptr, unsigned int size)
   memory_pool      = ptr;
   memory_pool_size = size;
 
+  // clear free block index, for re-initialize.
+  memset(free_blocks, 0, sizeof(free_blocks));
+  free_fli_bitmap = 0;
+  memset(free_sli_bitmap, 0, sizeof(free_sli_bitmap));
+
   // initialize memory pool
   FREE_BLOCK *block = (FREE_BLOCK *)memory_pool;
   block->t           = FLAG_TAIL_BLOCK;
@@ -379,7 +395,9 @@ uint8_t* mrbc_raw_alloc(unsigned int size)
   memset( (uint8_t *)target + sizeof(USED_BLOCK), 0xaa,
           target->size - sizeof(USED_BLOCK) );
 #endif
-  target->vm_id = 0;
+  target->vm_id  = 0;
+  target->tt     = MRB_TT_EMPTY;
+  target->frozen = 0;
 
   return (uint8_t *)target + sizeof(USED_BLOCK);
 }
@@ -473,8 +491,10 @@ uint8_t* mrbc_raw_realloc(void *ptr, unsigned int size)
   uint8_t *new_ptr = mrbc_raw_alloc(size);
   if( new_ptr == NULL ) return NULL;  // ENOMEM
 
-  memcpy(new_ptr, ptr, target->size);
+  memcpy(new_ptr, ptr, target->size - sizeof(USED_BLOCK));
   SET_VM_ID(new_ptr, target->vm_id);
+  SET_TT(new_ptr, target->tt);
+  BLOCK_HEADER(new_ptr)->frozen = target->frozen;
   mrbc_raw_free(ptr);
 
   return new_ptr;
@@ -579,3 +599,130 @@ int mrbc_get_vm_id(void *ptr)
 {
   return GET_VM_ID(ptr);
 }
+
+
+//================================================================
+/*! set object type tag
+
+  @param  ptr	Return value of mrbc_alloc()
+  @param  tt	type tag (mrb_vtype). 0 to 31, stored in 5 bits.
+*/
+void mrbc_set_tt(void *ptr, int tt)
+{
+  SET_TT(ptr, tt);
+}
+
+
+//================================================================
+/*! get object type tag
+
+  @param  ptr	Return value of mrbc_alloc()
+  @return int	type tag (mrb_vtype)
+*/
+int mrbc_get_tt(void *ptr)
+{
+  return (int8_t)GET_TT(ptr);
+}
+
+
+//================================================================
+/*! mark the block frozen
+
+  @param  ptr	Return value of mrbc_alloc()
+*/
+void mrbc_set_frozen(void *ptr)
+{
+  BLOCK_HEADER(ptr)->frozen = 1;
+}
+
+
+//================================================================
+/*! check the block is frozen
+
+  @param  ptr	Return value of mrbc_alloc()
+  @return int	1 if frozen
+*/
+int mrbc_is_frozen(void *ptr)
+{
+  return BLOCK_HEADER(ptr)->frozen;
+}
+
+
+//================================================================
+/*! check the pointer was allocated from memory pool
+
+  @param  ptr	pointer
+  @return int	1 if in memory pool
+*/
+int mrbc_is_pool_ptr(const void *ptr)
+{
+  return ((const uint8_t *)ptr >= memory_pool &&
+          (const uint8_t *)ptr < memory_pool + memory_pool_size);
+}
+
+
+//================================================================
+/*! get memory pool
+
+  @param  size	returns size of memory pool.
+  @return	pointer to memory pool.
+*/
+void *mrbc_get_memory_pool(unsigned int *size)
+{
+  *size = memory_pool_size;
+  return memory_pool;
+}
+
+
+//================================================================
+/*! apply func to static variables and memory pool, for snapshot.
+
+  @param  func	write or read function.
+  @param  arg	user argument.
+  @retval 0	No error.
+*/
+int mrbc_alloc_snapshot(mrbc_snapshot_func func, void *arg)
+{
+  return func(free_blocks, sizeof(free_blocks), arg) ||
+         func(&free_fli_bitmap, sizeof(free_fli_bitmap), arg) ||
+         func(free_sli_bitmap, sizeof(free_sli_bitmap), arg) ||
+         func(memory_pool, memory_pool_size, arg);
+}
+
+
+#ifdef MRBC_DEBUG
+
+//================================================================
+/*! dump all memory blocks
+
+  @param  fp	output stream.
+
+  One line per physical block, in address order.
+  "offset size vm_id U|R|F tt"  (offset from pool top, hex)
+  U: used, R: used and frozen, F: free.
+  tools/heap_analyzer.rb reads this format.
+*/
+void mrbc_heap_dump(FILE *fp)
+{
+  USED_BLOCK *ptr = (USED_BLOCK *)memory_pool;
+  int flag_loop = 1;
+
+  fprintf(fp, "# mrbc_heap_dump pool=%p size=%u\n",
+          (void *)memory_pool, memory_pool_size);
+
+  while( flag_loop ) {
+    if( ptr->t == FLAG_TAIL_BLOCK ) flag_loop = 0;
+    if( ptr->f == FLAG_FREE_BLOCK ) {
+      fprintf(fp, "%05x %5u   - F   -\n",
+              (unsigned int)((uint8_t *)ptr - memory_pool),
+              (unsigned int)ptr->size);
+    } else {
+      fprintf(fp, "%05x %5u %3d %c %3d\n",
+              (unsigned int)((uint8_t *)ptr - memory_pool),
+              (unsigned int)ptr->size, ptr->vm_id,
+              ptr->frozen ? 'R' : 'U', (int8_t)ptr->tt);
+    }
+    ptr = (USED_BLOCK *)PHYS_NEXT(ptr);
+  }
+}
+#endif
@@ -17,6 +17,9 @@
 #define MRBC_SRC_ALLOC_H_
 
 #include <stdint.h>
+#ifdef MRBC_DEBUG
+#include <stdio.h>
+#endif
 #include "vm.h"
 
 #ifdef __cplusplus
@@ -35,6 +38,15 @@ void mrbc_free(const mrb_vm *vm, void *ptr);
 void mrbc_free_all(const mrb_vm *vm);
 void mrbc_set_vm_id(void *ptr, int vm_id);
 int mrbc_get_vm_id(void *ptr);
+void mrbc_set_tt(void *ptr, int tt);
+int mrbc_get_tt(void *ptr);
+void mrbc_set_frozen(void *ptr);
+int mrbc_is_frozen(void *ptr);
+int mrbc_is_pool_ptr(const void *ptr);
+void *mrbc_get_memory_pool(unsigned int *size);
+#ifdef MRBC_DEBUG
+void mrbc_heap_dump(FILE *fp);
+#endif
 
 #ifdef __cplusplus
 }
@@ -1,11 +1,14 @@
 #include <stddef.h>
 
 #include "c_array.h"
+#include "c_enum.h"
 
 #include "alloc.h"
 #include "class.h"
 #include "static.h"
 #include "value.h"
+#include "console.h"
+#include "vm.h"
 
 // Internal use only
 // get size of array
@@ -62,6 +65,12 @@ static void c_array_set(mrb_vm *vm, mrb_value *v)
   int pos = GET_INT_ARG(1);
   mrb_value *array = v->obj;
 
+  if( mrbc_is_frozen_object(v) ){
+    console_printf("can't modify frozen Array\n");
+    SET_NIL_RETURN();
+    return;
+  }
+
   if( pos >= 0 && pos < array->i ){
     array[pos+1] = GET_ARG(2);
   } else {
@@ -79,6 +88,7 @@ static void c_array_plus(mrb_vm *vm, mrb_value *v)
   
   mrb_value *new_array = (mrb_value *)mrbc_alloc(vm, sizeof(mrb_value)*(len1+len2+1));
   if( new_array == NULL ) return;  // ENOMEM
+  mrbc_set_tt(new_array, MRB_TT_ARRAY);
 
   new_array->tt = MRB_TT_FIXNUM;
   new_array->i = len1 + len2;
@@ -96,19 +106,448 @@ static void c_array_plus(mrb_vm *vm, mrb_value *v)
 }
 
 
+// Internal use only
+// find value in array, return index or -1
+static int array_find(mrb_value *array, int len, mrb_value *value)
+{
+  int i;
+
+  // fast path for Fixnum and Symbol
+  if( value->tt == MRB_TT_FIXNUM || value->tt == MRB_TT_SYMBOL ){
+    for( i=0 ; i<len ; i++ ){
+      if( array[i].tt == value->tt && array[i].i == value->i ) return i;
+    }
+    return -1;
+  }
+
+  for( i=0 ; i<len ; i++ ){
+    // check EQ
+    if( mrbc_eq(array+i, value) ) return i;
+  }
+  return -1;
+}
+
+
 static void c_array_index(mrb_vm *vm, mrb_value *v)
 {
   int len = v->array->i;
   mrb_value *array = v->array + 1;
   mrb_value value = GET_ARG(1);
 
+  int i = array_find(array, len, &value);
+  if( i >= 0 ){
+    SET_INT_RETURN(i);
+  } else {
+    SET_NIL_RETURN();
+  }
+}
+
+
+// Array#include?
+static void c_array_include(mrb_vm *vm, mrb_value *v)
+{
+  int len = v->array->i;
+  mrb_value *array = v->array + 1;
+  mrb_value value = GET_ARG(1);
+
+  if( array_find(array, len, &value) >= 0 ){
+    SET_TRUE_RETURN();
+  } else {
+    SET_FALSE_RETURN();
+  }
+}
+
+
+//================================================================
+/*! sort context
+
+  The comparison is chosen once per sort, by the element types.
+*/
+enum {
+  SORT_GENERIC,
+  SORT_FIXNUM,
+  SORT_FLOAT,
+  SORT_BLOCK,
+};
+
+typedef struct SORT_CONTEXT {
+  int mode;		// SORT_XXX
+  mrb_vm *vm;
+  mrb_value *regs;	// register window for block call
+  mrb_proc *proc;	// comparison block
+  mrb_value *sub;	// array moved together with the keys, or NULL
+} sort_context;
+
+#define SORT_INSERTION_SIZE 16
+
+
+// Internal use only
+// choose comparison mode
+static int sort_mode(mrb_value *array, int len)
+{
+  if( len == 0 ) return SORT_GENERIC;
+
+  mrb_vtype tt = array[0].tt;
+  int i;
+  for( i=1 ; i<len ; i++ ){
+    if( array[i].tt != tt ) return SORT_GENERIC;
+  }
+  if( tt == MRB_TT_FIXNUM ) return SORT_FIXNUM;
+#if MRBC_USE_FLOAT
+  if( tt == MRB_TT_FLOAT ) return SORT_FLOAT;
+#endif
+  return SORT_GENERIC;
+}
+
+
+// Internal use only
+// compare two elements by block
+static int sort_cmp_block(sort_context *ctx, mrb_value *a, mrb_value *b)
+{
+  ctx->regs[1] = *a;
+  ctx->regs[2] = *b;
+  mrbc_call_proc(ctx->vm, ctx->regs, ctx->proc, 2);
+
+  switch( ctx->regs[0].tt ){
+  case MRB_TT_FIXNUM:
+    return ctx->regs[0].i;
+#if MRBC_USE_FLOAT
+  case MRB_TT_FLOAT:
+    return (ctx->regs[0].d > 0) - (ctx->regs[0].d < 0);
+#endif
+  default:
+    return 0;
+  }
+}
+
+
+// Internal use only
+// compare two elements
+static inline int sort_cmp(sort_context *ctx, mrb_value *a, mrb_value *b)
+{
+  switch( ctx->mode ){
+  case SORT_FIXNUM:
+    return (a->i > b->i) - (a->i < b->i);
+#if MRBC_USE_FLOAT
+  case SORT_FLOAT:
+    return (a->d > b->d) - (a->d < b->d);
+#endif
+  case SORT_BLOCK:
+    return sort_cmp_block(ctx, a, b);
+  default:
+    return mrbc_compare(a, b);
+  }
+}
+
+
+// Internal use only
+// swap two elements
+static inline void sort_swap(sort_context *ctx, mrb_value *a, int i, int j)
+{
+  mrb_value tmp = a[i];
+  a[i] = a[j];
+  a[j] = tmp;
+
+  if( ctx->sub ){
+    tmp = ctx->sub[i];
+    ctx->sub[i] = ctx->sub[j];
+    ctx->sub[j] = tmp;
+  }
+}
+
+
+// Internal use only
+// insertion sort a[lo]..a[hi-1]
+static void sort_insertion(sort_context *ctx, mrb_value *a, int lo, int hi)
+{
+  int i, j;
+  for( i=lo+1 ; i<hi ; i++ ){
+    for( j=i ; j>lo && sort_cmp(ctx, a+j-1, a+j) > 0 ; j-- ){
+      sort_swap(ctx, a, j-1, j);
+    }
+  }
+}
+
+
+// Internal use only
+// sift down a[lo+root] in heap of size
+static void sort_sift(sort_context *ctx, mrb_value *a, int lo, int root, int size)
+{
+  while( 1 ){
+    int child = root * 2 + 1;
+    if( child >= size ) break;
+    if( child+1 < size && sort_cmp(ctx, a+lo+child, a+lo+child+1) < 0 ){
+      child++;
+    }
+    if( sort_cmp(ctx, a+lo+root, a+lo+child) >= 0 ) break;
+    sort_swap(ctx, a, lo+root, lo+child);
+    root = child;
+  }
+}
+
+
+// Internal use only
+// heap sort a[lo]..a[hi-1]
+static void sort_heap(sort_context *ctx, mrb_value *a, int lo, int hi)
+{
+  int n = hi - lo;
+  int k;
+
+  for( k=n/2-1 ; k>=0 ; k-- ){
+    sort_sift(ctx, a, lo, k, n);
+  }
+  for( k=n-1 ; k>0 ; k-- ){
+    sort_swap(ctx, a, lo, lo+k);
+    sort_sift(ctx, a, lo, 0, k);
+  }
+}
+
+
+// Internal use only
+// introsort a[lo]..a[hi-1]
+static void sort_intro(sort_context *ctx, mrb_value *a, int lo, int hi, int depth)
+{
+  while( hi - lo > SORT_INSERTION_SIZE ){
+    if( depth-- == 0 ){
+      sort_heap(ctx, a, lo, hi);
+      return;
+    }
+
+    // median of three
+    int mid = lo + (hi - lo - 1) / 2;
+    if( sort_cmp(ctx, a+mid, a+lo) < 0 ) sort_swap(ctx, a, mid, lo);
+    if( sort_cmp(ctx, a+hi-1, a+mid) < 0 ){
+      sort_swap(ctx, a, hi-1, mid);
+      if( sort_cmp(ctx, a+mid, a+lo) < 0 ) sort_swap(ctx, a, mid, lo);
+    }
+    mrb_value pivot = a[mid];
+
+    // Hoare partition
+    int i = lo - 1;
+    int j = hi;
+    while( 1 ){
+      do { i++; } while( i < hi-1 && sort_cmp(ctx, a+i, &pivot) < 0 );
+      do { j--; } while( j > lo && sort_cmp(ctx, &pivot, a+j) < 0 );
+      if( i >= j ) break;
+      sort_swap(ctx, a, i, j);
+    }
+
+    // recurse into the smaller part.
+    if( j+1 - lo < hi - (j+1) ){
+      sort_intro(ctx, a, lo, j+1, depth);
+      lo = j+1;
+    } else {
+      sort_intro(ctx, a, j+1, hi, depth);
+      hi = j+1;
+    }
+  }
+
+  sort_insertion(ctx, a, lo, hi);
+}
+
+
+// Internal use only
+// sort array
+static void array_sort(sort_context *ctx, mrb_value *array, int len)
+{
+  int depth = 0;
+  int n;
+  for( n=len ; n>1 ; n >>= 1 ) depth += 2;
+
+  sort_intro(ctx, array, 0, len, depth);
+}
+
+
+// Internal use only
+// duplicate array
+static mrb_value *array_dup(mrb_vm *vm, mrb_value *array)
+{
+  int len = array->i;
+  mrb_value *new_array = (mrb_value *)mrbc_alloc(vm, sizeof(mrb_value)*(len+1));
+  if( new_array == NULL ) return NULL;  // ENOMEM
+  mrbc_set_tt(new_array, MRB_TT_ARRAY);
+
+  int i;
+  for( i=0 ; i<=len ; i++ ){
+    new_array[i] = array[i];
+  }
+  return new_array;
+}
+
+
+// Internal use only
+// set up sort context for Array#sort and sort!
+static void sort_context_init(sort_context *ctx, mrb_vm *vm, mrb_value *v, mrb_value *array, int len)
+{
+  ctx->vm = vm;
+  ctx->sub = NULL;
+  if( v[1].tt == MRB_TT_PROC ){
+    ctx->mode = SORT_BLOCK;
+    ctx->proc = v[1].proc;
+    ctx->regs = v + 2;
+  } else {
+    ctx->mode = sort_mode(array, len);
+  }
+}
+
+
+// Array#sort
+static void c_array_sort(mrb_vm *vm, mrb_value *v)
+{
+  mrb_value *new_array = array_dup(vm, v->array);
+  if( new_array == NULL ) return;  // ENOMEM
+
+  sort_context ctx;
+  sort_context_init(&ctx, vm, v, new_array+1, new_array->i);
+  array_sort(&ctx, new_array+1, new_array->i);
+
+  // return
+  v->tt = MRB_TT_ARRAY;
+  v->array = new_array;
+}
+
+
+// Array#sort!
+static void c_array_sort_bang(mrb_vm *vm, mrb_value *v)
+{
+  if( mrbc_is_frozen_object(v) ){
+    console_printf("can't modify frozen Array\n");
+    SET_NIL_RETURN();
+    return;
+  }
+
+  sort_context ctx;
+  sort_context_init(&ctx, vm, v, v->array+1, v->array->i);
+  array_sort(&ctx, v->array+1, v->array->i);
+}
+
+
+// Array#sort_by
+static void c_array_sort_by(mrb_vm *vm, mrb_value *v)
+{
+  if( v[1].tt != MRB_TT_PROC ){
+    console_printf("no block given (sort_by)\n");
+    SET_NIL_RETURN();
+    return;
+  }
+
+  int len = v->array->i;
+  mrb_value *new_array = array_dup(vm, v->array);
+  if( new_array == NULL ) return;  // ENOMEM
+  mrb_value *keys = (mrb_value *)mrbc_alloc(vm, sizeof(mrb_value)*(len+1));
+  if( keys == NULL ){  // ENOMEM
+    mrbc_free(vm, new_array);
+    return;
+  }
+
+  // evaluate keys
+  mrb_value *regs = v + 2;
   int i;
   for( i=0 ; i<len ; i++ ){
-    // check EQ
-    if( mrbc_eq(array+i, &value) ) break;
+    regs[1] = new_array[i+1];
+    mrbc_call_proc(vm, regs, v[1].proc, 1);
+    keys[i] = regs[0];
   }
-  if( i<len ){
-    SET_INT_RETURN(i);
+
+  sort_context ctx;
+  ctx.vm = vm;
+  ctx.mode = sort_mode(keys, len);
+  ctx.sub = new_array+1;
+  array_sort(&ctx, keys, len);
+  mrbc_free(vm, keys);
+
+  // return
+  v->tt = MRB_TT_ARRAY;
+  v->array = new_array;
+}
+
+
+// Internal use only
+// find min or max. dir: 1=max, -1=min
+static void array_minmax(mrb_value *v, int dir)
+{
+  int len = v->array->i;
+  mrb_value *array = v->array + 1;
+
+  if( len == 0 ){
+    SET_NIL_RETURN();
+    return;
+  }
+
+  sort_context ctx;
+  ctx.mode = sort_mode(array, len);
+  mrb_value *p = array;
+  int i;
+  for( i=1 ; i<len ; i++ ){
+    if( sort_cmp(&ctx, array+i, p) * dir > 0 ) p = array+i;
+  }
+  SET_RETURN( *p );
+}
+
+
+// Array#min
+static void c_array_min(mrb_vm *vm, mrb_value *v)
+{
+  array_minmax(v, -1);
+}
+
+
+// Array#max
+static void c_array_max(mrb_vm *vm, mrb_value *v)
+{
+  array_minmax(v, 1);
+}
+
+
+// Array#bsearch
+//  find-minimum mode (block returns true/false)
+//  find-any mode (block returns number)
+static void c_array_bsearch(mrb_vm *vm, mrb_value *v)
+{
+  if( v[1].tt != MRB_TT_PROC ){
+    console_printf("no block given (bsearch)\n");
+    SET_NIL_RETURN();
+    return;
+  }
+
+  mrb_value *array = v->array + 1;
+  mrb_value *regs = v + 2;
+  int lo = 0;
+  int hi = v->array->i;
+  int found = -1;
+
+  while( lo < hi ){
+    int mid = lo + (hi - lo) / 2;
+    int res;
+    regs[1] = array[mid];
+    mrbc_call_proc(vm, regs, v[1].proc, 1);
+
+    switch( regs[0].tt ){
+    case MRB_TT_TRUE:	res = 0; found = mid; hi = mid; continue;
+    case MRB_TT_FALSE:
+    case MRB_TT_NIL:	res = 1; break;
+    case MRB_TT_FIXNUM:	res = regs[0].i; break;
+#if MRBC_USE_FLOAT
+    case MRB_TT_FLOAT:	res = (regs[0].d > 0) - (regs[0].d < 0); break;
+#endif
+    default:
+      console_printf("wrong value in block (bsearch)\n");
+      SET_NIL_RETURN();
+      return;
+    }
+    if( res == 0 ){
+      found = mid;
+      break;
+    }
+    if( res > 0 ){
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  if( found >= 0 ){
+    SET_RETURN( array[found] );
   } else {
     SET_NIL_RETURN();
   }
@@ -137,6 +576,11 @@ static void c_array_last(mrb_vm *vm, mrb_value *v)
 
 static void c_array_pop(mrb_vm *vm, mrb_value *v)
 {
+	if( mrbc_is_frozen_object(v) ){
+		console_printf("can't modify frozen Array\n");
+		SET_NIL_RETURN();
+		return;
+	}
 	mrb_object *obj = v->obj;
 	mrb_object *tmp = obj->next;
 	while( tmp->next ){
@@ -154,7 +598,6 @@ void mrbc_init_class_array(mrb_vm *vm)
   mrbc_class_array = mrbc_class_alloc(vm, "Array", mrbc_class_object);
 
   mrbc_define_method(vm, mrbc_class_array, "!=", c_array_neq);
-  mrbc_define_method(vm, mrbc_class_array, "count", c_array_size);
   mrbc_define_method(vm, mrbc_class_array, "length", c_array_size);
   mrbc_define_method(vm, mrbc_class_array, "size", c_array_size);
   mrbc_define_method(vm, mrbc_class_array, "+", c_array_plus);
@@ -163,9 +606,18 @@ void mrbc_init_class_array(mrb_vm *vm)
   mrbc_define_method(vm, mrbc_class_array, "at", c_array_get);
   mrbc_define_method(vm, mrbc_class_array, "[]=", c_array_set);
   mrbc_define_method(vm, mrbc_class_array, "index", c_array_index);
+  mrbc_define_method(vm, mrbc_class_array, "include?", c_array_include);
+  mrbc_define_method(vm, mrbc_class_array, "sort", c_array_sort);
+  mrbc_define_method(vm, mrbc_class_array, "sort!", c_array_sort_bang);
+  mrbc_define_method(vm, mrbc_class_array, "sort_by", c_array_sort_by);
+  mrbc_define_method(vm, mrbc_class_array, "min", c_array_min);
+  mrbc_define_method(vm, mrbc_class_array, "max", c_array_max);
+  mrbc_define_method(vm, mrbc_class_array, "bsearch", c_array_bsearch);
 
 
   mrbc_define_method(vm, mrbc_class_array, "first", c_array_first);
   mrbc_define_method(vm, mrbc_class_array, "last", c_array_last);
   mrbc_define_method(vm, mrbc_class_array, "pop", c_array_pop);
+
+  mrbc_define_enum_methods(vm, mrbc_class_array);
 }
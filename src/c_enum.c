@@ -0,0 +1,387 @@
+/*! @file
+  @brief
+  Enumerable methods for Array and Range.
+
+  <pre>
+  Copyright (C) 2015 Kyushu Institute of Technology.
+  Copyright (C) 2015 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  Block is called through mrbc_call_proc(), in the register window
+  next to the block argument. Result arrays are allocated once, in
+  the size of the receiver.
+  </pre>
+*/
+
+#include <stddef.h>
+
+#include "c_enum.h"
+
+#include "alloc.h"
+#include "class.h"
+#include "static.h"
+#include "value.h"
+#include "console.h"
+#include "vm.h"
+
+
+//================================================================
+/*!@brief
+  Elements of Array or Range.
+*/
+typedef struct ENUM_SEQ {
+  mrb_value *array;	// Array: elements, Range: NULL
+  int32_t first;	// Range: first value
+  int len;
+} enum_seq;
+
+
+// Internal use only
+// get sequence of receiver
+static int enum_seq_init(enum_seq *seq, mrb_value *v)
+{
+  if( v->tt == MRB_TT_ARRAY ){
+    seq->array = v->array + 1;
+    seq->first = 0;
+    seq->len = v->array->i;
+    return 0;
+  }
+
+  mrb_value *range = v->range;
+  if( range[1].tt != MRB_TT_FIXNUM || range[2].tt != MRB_TT_FIXNUM ){
+    console_printf("can't iterate Range\n");
+    return -1;
+  }
+  seq->array = NULL;
+  seq->first = range[1].i;
+  seq->len = range[2].i - range[1].i + (range[0].tt == MRB_TT_TRUE ? 0 : 1);
+  if( seq->len < 0 ) seq->len = 0;
+  return 0;
+}
+
+
+// Internal use only
+// get n-th element
+static inline mrb_value enum_seq_get(enum_seq *seq, int n)
+{
+  if( seq->array ) return seq->array[n];
+
+  mrb_value ret;
+  ret.tt = MRB_TT_FIXNUM;
+  ret.i = seq->first + n;
+  return ret;
+}
+
+
+// Internal use only
+// truthy?
+static inline int enum_test(mrb_value *v)
+{
+  return v->tt != MRB_TT_FALSE && v->tt != MRB_TT_NIL;
+}
+
+
+// Internal use only
+// allocate array
+static mrb_value *enum_array_alloc(mrb_vm *vm, int len)
+{
+  mrb_value *array = (mrb_value *)mrbc_alloc(vm, sizeof(mrb_value)*(len+1));
+  if( array == NULL ) return NULL;  // ENOMEM
+  mrbc_set_tt(array, MRB_TT_ARRAY);
+
+  array->tt = MRB_TT_FIXNUM;
+  array->i = len;
+  return array;
+}
+
+
+// Internal use only
+// check block
+static int enum_has_block(mrb_value *v, int n, const char *name)
+{
+  if( v[n].tt == MRB_TT_PROC ) return 1;
+
+  console_printf("no block given (%s)\n", name);
+  SET_NIL_RETURN();
+  return 0;
+}
+
+
+// each
+static void c_enum_each(mrb_vm *vm, mrb_value *v)
+{
+  enum_seq seq;
+  if( !enum_has_block(v, 1, "each") || enum_seq_init(&seq, v) ) return;
+
+  mrb_value *regs = v + 2;
+  int i;
+  for( i=0 ; i<seq.len ; i++ ){
+    regs[1] = enum_seq_get(&seq, i);
+    mrbc_call_proc(vm, regs, v[1].proc, 1);
+  }
+}
+
+
+// each_with_index
+static void c_enum_each_with_index(mrb_vm *vm, mrb_value *v)
+{
+  enum_seq seq;
+  if( !enum_has_block(v, 1, "each_with_index") || enum_seq_init(&seq, v) ) return;
+
+  mrb_value *regs = v + 2;
+  int i;
+  for( i=0 ; i<seq.len ; i++ ){
+    regs[1] = enum_seq_get(&seq, i);
+    regs[2].tt = MRB_TT_FIXNUM;
+    regs[2].i = i;
+    mrbc_call_proc(vm, regs, v[1].proc, 2);
+  }
+}
+
+
+// map, collect
+static void c_enum_map(mrb_vm *vm, mrb_value *v)
+{
+  enum_seq seq;
+  if( !enum_has_block(v, 1, "map") || enum_seq_init(&seq, v) ) return;
+
+  mrb_value *result = enum_array_alloc(vm, seq.len);
+  if( result == NULL ) return;  // ENOMEM
+
+  mrb_value *regs = v + 2;
+  int i;
+  for( i=0 ; i<seq.len ; i++ ){
+    regs[1] = enum_seq_get(&seq, i);
+    mrbc_call_proc(vm, regs, v[1].proc, 1);
+    result[i+1] = regs[0];
+  }
+
+  v->tt = MRB_TT_ARRAY;
+  v->array = result;
+}
+
+
+// Internal use only
+// select or reject
+static void enum_filter(mrb_vm *vm, mrb_value *v, int want, const char *name)
+{
+  enum_seq seq;
+  if( !enum_has_block(v, 1, name) || enum_seq_init(&seq, v) ) return;
+
+  mrb_value *result = enum_array_alloc(vm, seq.len);
+  if( result == NULL ) return;  // ENOMEM
+
+  mrb_value *regs = v + 2;
+  int i, n = 0;
+  for( i=0 ; i<seq.len ; i++ ){
+    mrb_value item = enum_seq_get(&seq, i);
+    regs[1] = item;
+    mrbc_call_proc(vm, regs, v[1].proc, 1);
+    if( enum_test(regs) == want ) result[++n] = item;
+  }
+
+  // shrink
+  if( n < seq.len ){
+    mrb_value *p = (mrb_value *)mrbc_realloc(vm, result, sizeof(mrb_value)*(n+1));
+    if( p != NULL ) result = p;
+  }
+  result->i = n;
+
+  v->tt = MRB_TT_ARRAY;
+  v->array = result;
+}
+
+
+// select
+static void c_enum_select(mrb_vm *vm, mrb_value *v)
+{
+  enum_filter(vm, v, 1, "select");
+}
+
+
+// reject
+static void c_enum_reject(mrb_vm *vm, mrb_value *v)
+{
+  enum_filter(vm, v, 0, "reject");
+}
+
+
+// reduce, inject
+//  reduce { |memo, x| }
+//  reduce(init) { |memo, x| }
+static void c_enum_reduce(mrb_vm *vm, mrb_value *v)
+{
+  enum_seq seq;
+  int blk = (v[1].tt == MRB_TT_PROC || v[1].tt == MRB_TT_NIL) ? 1 : 2;
+  if( !enum_has_block(v, blk, "reduce") || enum_seq_init(&seq, v) ) return;
+
+  mrb_value memo;
+  int i = 0;
+  if( blk == 2 ){
+    memo = v[1];
+  } else if( seq.len > 0 ){
+    memo = enum_seq_get(&seq, i++);
+  } else {
+    SET_NIL_RETURN();
+    return;
+  }
+
+  mrb_proc *proc = v[blk].proc;
+  mrb_value *regs = v + blk + 1;
+  for( ; i<seq.len ; i++ ){
+    regs[1] = memo;
+    regs[2] = enum_seq_get(&seq, i);
+    mrbc_call_proc(vm, regs, proc, 2);
+    memo = regs[0];
+  }
+
+  SET_RETURN( memo );
+}
+
+
+// sum
+//  sum
+//  sum(init)
+//  sum { |x| }
+static void c_enum_sum(mrb_vm *vm, mrb_value *v)
+{
+  enum_seq seq;
+  if( enum_seq_init(&seq, v) ) return;
+
+  mrb_proc *proc = NULL;
+  mrb_value *regs = NULL;
+  int32_t sum_i = 0;
+#if MRBC_USE_FLOAT
+  double sum_d = 0;
+  int is_float = 0;
+#endif
+
+  if( v[1].tt == MRB_TT_PROC ){
+    proc = v[1].proc;
+    regs = v + 2;
+  } else if( v[1].tt != MRB_TT_NIL ){
+    if( v[2].tt == MRB_TT_PROC ){
+      proc = v[2].proc;
+      regs = v + 3;
+    }
+    switch( v[1].tt ){
+    case MRB_TT_FIXNUM:	sum_i = v[1].i; break;
+#if MRBC_USE_FLOAT
+    case MRB_TT_FLOAT:	sum_d = v[1].d; is_float = 1; break;
+#endif
+    default: break;
+    }
+  }
+
+  // Fixnum range, closed form.
+  if( proc == NULL && seq.array == NULL ){
+    int64_t n = seq.len;
+    int64_t s = n * (2 * (int64_t)seq.first + n - 1) / 2;
+#if MRBC_USE_FLOAT
+    if( is_float ){
+      SET_FLOAT_RETURN( sum_d + s );
+      return;
+    }
+#endif
+    SET_INT_RETURN( sum_i + (int32_t)s );
+    return;
+  }
+
+  int i;
+  for( i=0 ; i<seq.len ; i++ ){
+    mrb_value item = enum_seq_get(&seq, i);
+    if( proc ){
+      regs[1] = item;
+      mrbc_call_proc(vm, regs, proc, 1);
+      item = regs[0];
+    }
+
+    switch( item.tt ){
+    case MRB_TT_FIXNUM:
+#if MRBC_USE_FLOAT
+      if( is_float ){
+        sum_d += item.i;
+        break;
+      }
+#endif
+      sum_i += item.i;
+      break;
+#if MRBC_USE_FLOAT
+    case MRB_TT_FLOAT:
+      if( !is_float ){
+        sum_d += sum_i;
+        is_float = 1;
+      }
+      sum_d += item.d;
+      break;
+#endif
+    default:
+      console_printf("sum supports only Fixnum and Float\n");
+      SET_NIL_RETURN();
+      return;
+    }
+  }
+
+#if MRBC_USE_FLOAT
+  if( is_float ){
+    SET_FLOAT_RETURN( sum_d );
+    return;
+  }
+#endif
+  SET_INT_RETURN( sum_i );
+}
+
+
+// count
+//  count
+//  count(obj)
+//  count { |x| }
+static void c_enum_count(mrb_vm *vm, mrb_value *v)
+{
+  enum_seq seq;
+  if( enum_seq_init(&seq, v) ) return;
+
+  int i, n = 0;
+  if( v[1].tt == MRB_TT_PROC ){
+    mrb_value *regs = v + 2;
+    for( i=0 ; i<seq.len ; i++ ){
+      regs[1] = enum_seq_get(&seq, i);
+      mrbc_call_proc(vm, regs, v[1].proc, 1);
+      if( enum_test(regs) ) n++;
+    }
+
+  } else if( v[1].tt == MRB_TT_NIL ){
+    n = seq.len;
+
+  } else {
+    for( i=0 ; i<seq.len ; i++ ){
+      mrb_value item = enum_seq_get(&seq, i);
+      if( mrbc_eq(&item, v+1) ) n++;
+    }
+  }
+
+  SET_INT_RETURN( n );
+}
+
+
+//================================================================
+/*!@brief
+  define Enumerable methods to the class.
+
+  @param  vm	A pointer of VM.
+  @param  cls	Array or Range.
+*/
+void mrbc_define_enum_methods(mrb_vm *vm, mrb_class *cls)
+{
+  mrbc_define_method(vm, cls, "each", c_enum_each);
+  mrbc_define_method(vm, cls, "each_with_index", c_enum_each_with_index);
+  mrbc_define_method(vm, cls, "map", c_enum_map);
+  mrbc_define_method(vm, cls, "collect", c_enum_map);
+  mrbc_define_method(vm, cls, "select", c_enum_select);
+  mrbc_define_method(vm, cls, "reject", c_enum_reject);
+  mrbc_define_method(vm, cls, "reduce", c_enum_reduce);
+  mrbc_define_method(vm, cls, "inject", c_enum_reduce);
+  mrbc_define_method(vm, cls, "sum", c_enum_sum);
+  mrbc_define_method(vm, cls, "count", c_enum_count);
+}
@@ -0,0 +1,31 @@
+/*! @file
+  @brief
+  Enumerable methods for Array and Range.
+
+  <pre>
+  Copyright (C) 2015 Kyushu Institute of Technology.
+  Copyright (C) 2015 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+
+  </pre>
+*/
+
+#ifndef MRBC_SRC_C_ENUM_H_
+#define MRBC_SRC_C_ENUM_H_
+
+#include "vm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+void mrbc_define_enum_methods(mrb_vm *vm, mrb_class *cls);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
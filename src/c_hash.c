@@ -1,79 +1,603 @@
 #include <stddef.h>
+#include <string.h>
 
 #include "c_hash.h"
+#if defined(__SSE2__) && HASH_LINEAR_MAX == 8
+#include <emmintrin.h>
+#endif
 
 #include "alloc.h"
 #include "class.h"
 #include "static.h"
 #include "value.h"
+#include "console.h"
+#include "vm.h"
 
-static void c_hash_size(mrb_vm *vm, mrb_value *v)
+#define HASH_INDEX_EMPTY   (-1)
+#define HASH_INDEX_DELETED (-2)
+
+
+// Internal use only
+// calculate hash value of key
+static uint32_t hash_calc(const mrb_value *key)
 {
-  mrb_value *hash = v->obj;
+  uint32_t h;
+
+  switch( key->tt ){
+  case MRB_TT_FIXNUM:
+  case MRB_TT_SYMBOL:
+    h = (uint32_t)key->i * 2654435761u;
+    break;
+
+#if MRBC_USE_FLOAT
+  case MRB_TT_FLOAT: {
+    uint32_t w[2];
+    if( key->d == 0 ) return 0;	// 0.0 == -0.0
+    memcpy(w, &key->d, sizeof(w));
+    h = (w[0] ^ w[1]) * 2654435761u;
+  } break;
+#endif
+
+  case MRB_TT_STRING: {
+    // FNV-1a
+    const uint8_t *p = (const uint8_t *)key->str;
+    h = 2166136261u;
+    while( *p ){
+      h = (h ^ *p++) * 16777619u;
+    }
+  } break;
 
-  SET_INT_RETURN(hash->obj->i);
+  case MRB_TT_ARRAY: {
+    int i, n = key->array->i;
+    h = n;
+    for( i=1 ; i<=n ; i++ ){
+      h = h * 31 + hash_calc(key->array + i);
+    }
+  } break;
+
+  default:
+    h = key->tt;
+    break;
+  }
+
+  return h ^ (h >> 16);
 }
 
 
-// Hash = []
-static void c_hash_get(mrb_vm *vm, mrb_value *v)
+// Internal use only
+// compare keys
+static inline int hash_key_eq(mrb_value *v1, mrb_value *v2)
+{
+  if( v1->tt != v2->tt ) return 0;
+  if( v1->tt == MRB_TT_FIXNUM || v1->tt == MRB_TT_SYMBOL ){
+    return v1->i == v2->i;
+  }
+  return mrbc_eq(v1, v2);
+}
+
+
+// Internal use only
+// search symbol in sym_keys, return entry number or -1
+static inline int hash_search_sym(mrb_hash *h, mrb_sym sym)
+{
+#if defined(__SSE2__) && HASH_LINEAR_MAX == 8
+  // compare 8 keys at once.
+  __m128i keys = _mm_loadu_si128((const __m128i *)h->sym_keys);
+  int mask = _mm_movemask_epi8(_mm_cmpeq_epi16(keys, _mm_set1_epi16(sym)));
+  mask &= (1 << (h->used * 2)) - 1;
+  return mask ? __builtin_ctz(mask) / 2 : -1;
+#else
+  int i;
+  for( i=0 ; i<h->used ; i++ ){
+    if( h->sym_keys[i] == sym ) return i;
+  }
+  return -1;
+#endif
+}
+
+
+// Internal use only
+// rebuild sym_keys
+static void hash_sym_keys_init(mrb_hash *h)
 {
-  mrb_value *hash = v->obj->obj;
   int i;
-  int n = hash->i;       // hash size
-  mrb_value key = GET_ARG(1);  // search key
 
-  // ptr: 1st entry(key) of hash
-  mrb_value *ptr = &hash[1];
+  // small hash only. index is NULL also when a large hash failed to
+  // allocate it, and sym_keys can't hold more than HASH_LINEAR_MAX keys.
+  h->flag_sym_keys = (h->capa <= HASH_LINEAR_MAX);
+  for( i=0 ; i<HASH_LINEAR_MAX ; i++ ){
+    h->sym_keys[i] = -1;
+  }
+  if( !h->flag_sym_keys ) return;
 
-  for( i=0 ; i<n ; i++ ){
-    if( mrbc_eq(ptr, &key) ){
-      SET_RETURN( *(ptr+1) );
+  for( i=0 ; i<h->used ; i++ ){
+    mrb_value *key = h->entries + i*2;
+    if( key->tt == MRB_TT_SYMBOL ){
+      h->sym_keys[i] = key->i;
+    } else if( key->tt != MRB_TT_EMPTY ){
+      h->flag_sym_keys = 0;
       return;
     }
-    ptr += 2;
   }
+}
+
+
+// Internal use only
+// search key, return entry number or -1
+static int hash_search(mrb_hash *h, mrb_value *key, int *slot)
+{
+  mrb_value *e = h->entries;
+  int i;
+
+  // small hash, linear search.
+  if( h->index == NULL ){
+    if( h->flag_sym_keys ){
+      if( key->tt != MRB_TT_SYMBOL ) return -1;
+      return hash_search_sym(h, key->i);
+    }
+    for( i=0 ; i<h->used ; i++ ){
+      if( hash_key_eq(e + i*2, key) ) return i;
+    }
+    return -1;
+  }
+
+  int mask = h->index_size - 1;
+  int cnt;
+  i = hash_calc(key) & mask;
+  for( cnt=0 ; cnt<h->index_size ; cnt++ ){
+    int n = h->index[i];
+    if( n == HASH_INDEX_EMPTY ) return -1;
+    if( n >= 0 && hash_key_eq(e + n*2, key) ){
+      if( slot ) *slot = i;
+      return n;
+    }
+    i = (i + 1) & mask;
+  }
+  return -1;
+}
 
+
+// Internal use only
+// add entry number to index
+static void hash_index_add(mrb_hash *h, int n)
+{
+  int mask = h->index_size - 1;
+  int i = hash_calc(h->entries + n*2) & mask;
+
+  while( h->index[i] >= 0 ){
+    i = (i + 1) & mask;
+  }
+  h->index[i] = n;
+}
+
+
+// Internal use only
+// allocate memory owned by the same VM as the hash
+static void *hash_alloc(mrb_vm *vm, mrb_hash *h, unsigned int size)
+{
+  void *ptr = mrbc_alloc(vm, size);
+  if( ptr == NULL ) return NULL;  // ENOMEM
+  mrbc_set_tt(ptr, MRB_TT_HASH);
+  if( mrbc_is_pool_ptr(h) ) mrbc_set_vm_id(ptr, mrbc_get_vm_id(h));
+  return ptr;
+}
+
+
+// Internal use only
+// remove deleted entries, change capacity and rebuild index
+static int hash_resize(mrb_vm *vm, mrb_hash *h, int capa)
+{
+  mrb_value *e = h->entries;
+  int ret = 0;
+  int i, n = 0;
+
+  // compaction, keeps order.
+  for( i=0 ; i<h->used ; i++ ){
+    if( e[i*2].tt == MRB_TT_EMPTY ) continue;
+    if( i != n ){
+      e[n*2]   = e[i*2];
+      e[n*2+1] = e[i*2+1];
+    }
+    n++;
+  }
+  h->used = n;
+
+  // entries
+  if( capa != h->capa ){
+    e = (mrb_value *)mrbc_realloc(vm, h->entries, sizeof(mrb_value)*2*capa);
+    if( e != NULL ){
+      h->entries = e;
+      h->capa = capa;
+    } else {
+      ret = -1;  // ENOMEM
+    }
+  }
+
+  // index
+  int size = 0;
+  if( h->capa > HASH_LINEAR_MAX ){
+    for( size = 16 ; size < h->capa * 2 ; size <<= 1 )
+      ;
+  }
+  if( size != h->index_size ){
+    if( h->index ) mrbc_free(vm, h->index);
+    h->index = (size == 0) ? NULL :
+      (int16_t *)hash_alloc(vm, h, sizeof(int16_t) * size);
+    h->index_size = h->index ? size : 0;  // linear search if ENOMEM
+  }
+  if( h->index ){
+    for( i=0 ; i<h->index_size ; i++ ){
+      h->index[i] = HASH_INDEX_EMPTY;
+    }
+    for( i=0 ; i<h->used ; i++ ){
+      hash_index_add(h, i);
+    }
+  }
+  hash_sym_keys_init(h);
+
+  return ret;
+}
+
+
+//================================================================
+/*!@brief
+  Create new Hash
+
+  @param  vm	Pointer of VM.
+  @param  capa	initial capacity.
+  @return	Hash object. hash is NULL if ENOMEM.
+*/
+mrb_value mrbc_hash_new(mrb_vm *vm, int capa)
+{
+  mrb_value value;
+  value.tt = MRB_TT_HASH;
+  value.hash = NULL;
+  if( capa < 1 ) capa = 1;
+
+  mrb_hash *h = (mrb_hash *)mrbc_alloc(vm, sizeof(mrb_hash));
+  if( h == NULL ) return value;  // ENOMEM
+  mrbc_set_tt(h, MRB_TT_HASH);
+
+  h->entries = (mrb_value *)mrbc_alloc(vm, sizeof(mrb_value)*2*capa);
+  if( h->entries == NULL ){  // ENOMEM
+    mrbc_free(vm, h);
+    return value;
+  }
+  mrbc_set_tt(h->entries, MRB_TT_HASH);
+
+  h->count = 0;
+  h->used = 0;
+  h->capa = capa;
+  h->index_size = 0;
+  h->index = NULL;
+  if( capa > HASH_LINEAR_MAX ){
+    hash_resize(vm, h, capa);
+  } else {
+    hash_sym_keys_init(h);
+  }
+
+  value.hash = h;
+  return value;
+}
+
+
+//================================================================
+/*!@brief
+  Get value
+
+  @param  hash	Hash object.
+  @param  key	key.
+  @return	pointer to value, or NULL if not found.
+*/
+mrb_value *mrbc_hash_get(mrb_value *hash, mrb_value *key)
+{
+  mrb_hash *h = hash->hash;
+  int n = hash_search(h, key, NULL);
+
+  return (n < 0) ? NULL : &h->entries[n*2+1];
+}
+
+
+//================================================================
+/*!@brief
+  Set value
+
+  @param  vm	Pointer of VM.
+  @param  hash	Hash object.
+  @param  key	key.
+  @param  val	value.
+  @retval 0	No error.
+  @retval -1	ENOMEM
+*/
+int mrbc_hash_set(mrb_vm *vm, mrb_value *hash, mrb_value *key, mrb_value *val)
+{
+  mrb_hash *h = hash->hash;
+  int n = hash_search(h, key, NULL);
+
+  if( n >= 0 ){
+    h->entries[n*2+1] = *val;  // Change value
+    return 0;
+  }
+
+  // key was not found
+  if( h->used == h->capa ){
+    // grow, or only remove deleted entries.
+    hash_resize(vm, h, (h->count >= h->capa * 3 / 4) ? h->capa * 2 : h->capa);
+    if( h->used == h->capa ) return -1;  // ENOMEM
+  }
+
+  n = h->used++;
+  h->entries[n*2]   = *key;
+  h->entries[n*2+1] = *val;
+  h->count++;
+  if( h->index ) hash_index_add(h, n);
+  if( h->flag_sym_keys ){
+    if( key->tt == MRB_TT_SYMBOL ){
+      h->sym_keys[n] = key->i;
+    } else {
+      h->flag_sym_keys = 0;
+    }
+  }
+
+  return 0;
+}
+
+
+//================================================================
+/*!@brief
+  Remove entry
+
+  @param  hash	Hash object.
+  @param  key	key.
+  @return	removed value, or nil if not found.
+*/
+mrb_value mrbc_hash_remove(mrb_value *hash, mrb_value *key)
+{
+  mrb_hash *h = hash->hash;
+  mrb_value ret;
+  int slot = 0;
+  int n = hash_search(h, key, &slot);
+
+  if( n < 0 ){
+    ret.tt = MRB_TT_NIL;
+    return ret;
+  }
+
+  mrb_value *e = h->entries + n*2;
+  ret = e[1];
+  e[0].tt = MRB_TT_EMPTY;
+  e[1].tt = MRB_TT_NIL;
+  if( h->index ) h->index[slot] = HASH_INDEX_DELETED;
+  if( h->flag_sym_keys ) h->sym_keys[n] = -1;
+  h->count--;
+  // the last slot can be reused, only if there is no index.
+  // DELETED marks in index are cleared by resize when used reaches capa.
+  if( !h->index && n == h->used - 1 ) h->used--;
+
+  return ret;
+}
+
+
+// Internal use only
+// check block
+static int hash_has_block(mrb_value *v, const char *name)
+{
+  if( v[1].tt == MRB_TT_PROC ) return 1;
+
+  console_printf("no block given (%s)\n", name);
   SET_NIL_RETURN();
+  return 0;
 }
 
+
+// Internal use only
+// call block with key and value. skip deleted entry.
+static int hash_yield(mrb_vm *vm, mrb_value *v, int i)
+{
+  mrb_value *e = v->hash->entries + i*2;
+  if( e[0].tt == MRB_TT_EMPTY ) return 0;
+
+  mrb_value *regs = v + 2;
+  regs[1] = e[0];
+  regs[2] = e[1];
+  mrbc_call_proc(vm, regs, v[1].proc, 2);
+  return 1;
+}
+
+
+// Internal use only
+// make Array of keys or values
+static void hash_to_array(mrb_vm *vm, mrb_value *v, int ofs)
+{
+  mrb_hash *h = v->hash;
+  mrb_value *array = (mrb_value *)mrbc_alloc(vm, sizeof(mrb_value)*(h->count+1));
+  if( array == NULL ) return;  // ENOMEM
+  mrbc_set_tt(array, MRB_TT_ARRAY);
+  array[0].tt = MRB_TT_FIXNUM;
+  array[0].i = h->count;
+
+  int i, n = 1;
+  for( i=0 ; i<h->used ; i++ ){
+    if( h->entries[i*2].tt == MRB_TT_EMPTY ) continue;
+    array[n++] = h->entries[i*2+ofs];
+  }
+
+  v->tt = MRB_TT_ARRAY;
+  v->array = array;
+}
+
+
+// Hash#size
+static void c_hash_size(mrb_vm *vm, mrb_value *v)
+{
+  SET_INT_RETURN(v->hash->count);
+}
+
+
+// Hash#empty?
+static void c_hash_empty(mrb_vm *vm, mrb_value *v)
+{
+  if( v->hash->count > 0 ){
+    SET_FALSE_RETURN();
+  } else {
+    SET_TRUE_RETURN();
+  }
+}
+
+
+// Hash = []
+static void c_hash_get(mrb_vm *vm, mrb_value *v)
+{
+  mrb_value *val = mrbc_hash_get(v, v+1);
+
+  if( val ){
+    SET_RETURN( *val );
+  } else {
+    SET_NIL_RETURN();
+  }
+}
+
+
 // Hash = []=
 static void c_hash_set(mrb_vm *vm, mrb_value *v)
 {
-  mrb_value *hash = v->obj->obj;
+  if( mrbc_is_frozen_object(v) ){
+    console_printf("can't modify frozen Hash\n");
+    SET_NIL_RETURN();
+    return;
+  }
+
+  mrbc_hash_set(vm, v, v+1, v+2);
+}
+
+
+// Hash#key?
+static void c_hash_has_key(mrb_vm *vm, mrb_value *v)
+{
+  if( mrbc_hash_get(v, v+1) ){
+    SET_TRUE_RETURN();
+  } else {
+    SET_FALSE_RETURN();
+  }
+}
+
+
+// Hash#delete
+static void c_hash_delete(mrb_vm *vm, mrb_value *v)
+{
+  if( mrbc_is_frozen_object(v) ){
+    console_printf("can't modify frozen Hash\n");
+    SET_NIL_RETURN();
+    return;
+  }
+
+  SET_RETURN( mrbc_hash_remove(v, v+1) );
+}
+
+
+// Hash#keys
+static void c_hash_keys(mrb_vm *vm, mrb_value *v)
+{
+  hash_to_array(vm, v, 0);
+}
+
+
+// Hash#values
+static void c_hash_values(mrb_vm *vm, mrb_value *v)
+{
+  hash_to_array(vm, v, 1);
+}
+
+
+// Hash#each
+//  each { |key, value| }
+static void c_hash_each(mrb_vm *vm, mrb_value *v)
+{
+  if( !hash_has_block(v, "each") ) return;
+
   int i;
-  int n = hash[0].i;       // hash size
-  mrb_value key = GET_ARG(1);  // search key
-  mrb_value val = GET_ARG(2);  // new value
-
-  mrb_value *ptr = &hash[1];
-  for( i=0 ; i<n ; i++ ){
-    if( mrbc_eq(ptr, &key) ){
-      *(ptr+1) = val;  // Change value
-      return;
+  for( i=0 ; i<v->hash->used ; i++ ){
+    hash_yield(vm, v, i);
+  }
+}
+
+
+// Hash#map
+//  map { |key, value| }
+static void c_hash_map(mrb_vm *vm, mrb_value *v)
+{
+  if( !hash_has_block(v, "map") ) return;
+
+  int n = v->hash->count;
+  mrb_value *result = (mrb_value *)mrbc_alloc(vm, sizeof(mrb_value)*(n+1));
+  if( result == NULL ) return;  // ENOMEM
+  mrbc_set_tt(result, MRB_TT_ARRAY);
+
+  int i, cnt = 0;
+  for( i=0 ; i<v->hash->used && cnt<n ; i++ ){
+    if( hash_yield(vm, v, i) ) result[++cnt] = v[2];
+  }
+  result[0].tt = MRB_TT_FIXNUM;
+  result[0].i = cnt;
+
+  v->tt = MRB_TT_ARRAY;
+  v->array = result;
+}
+
+
+// Internal use only
+// select or reject
+static void hash_filter(mrb_vm *vm, mrb_value *v, int want, const char *name)
+{
+  if( !hash_has_block(v, name) ) return;
+
+  mrb_value result = mrbc_hash_new(vm, v->hash->count);
+  if( result.hash == NULL ) return;  // ENOMEM
+
+  int i;
+  for( i=0 ; i<v->hash->used ; i++ ){
+    if( !hash_yield(vm, v, i) ) continue;
+    if( (v[2].tt != MRB_TT_FALSE && v[2].tt != MRB_TT_NIL) == want ){
+      mrb_value *e = v->hash->entries + i*2;
+      mrbc_hash_set(vm, &result, e, e+1);
     }
   }
 
-  // key was not found
-  // add hash entry (key and val)
-  int new_size = (n+1)*2 + 1;
+  SET_RETURN( result );
+}
+
 
-  // use alloc instead of realloc, realloc has some bugs?
-  mrb_value *new_hash = (mrb_value *)mrbc_alloc(vm, sizeof(mrb_value)*new_size);
-  if( new_hash == NULL ) return;  // ENOMEM
+// Hash#select
+static void c_hash_select(mrb_vm *vm, mrb_value *v)
+{
+  hash_filter(vm, v, 1, "select");
+}
+
+
+// Hash#reject
+static void c_hash_reject(mrb_vm *vm, mrb_value *v)
+{
+  hash_filter(vm, v, 0, "reject");
+}
 
-  mrb_value *src = &hash[1];
-  mrb_value *dst = &new_hash[1];
-  for( i=0 ; i<n ; i++ ){
-    *dst++ = *src++;  // copy key
-    *dst++ = *src++;  // copy value
+
+// Hash#count
+//  count
+//  count { |key, value| }
+static void c_hash_count(mrb_vm *vm, mrb_value *v)
+{
+  if( v[1].tt != MRB_TT_PROC ){
+    SET_INT_RETURN( v->hash->count );
+    return;
+  }
+
+  int i, cnt = 0;
+  for( i=0 ; i<v->hash->used ; i++ ){
+    if( hash_yield(vm, v, i) &&
+        v[2].tt != MRB_TT_FALSE && v[2].tt != MRB_TT_NIL ) cnt++;
   }
-  new_hash[0].tt = MRB_TT_FIXNUM;
-  new_hash[0].i = n+1;
-  *dst++ = key;
-  *dst   = val;
-  mrbc_free(vm, v->obj->obj);
-  v->obj->obj = new_hash;
+
+  SET_INT_RETURN( cnt );
 }
 
 
@@ -83,7 +607,22 @@ void mrbc_init_class_hash(mrb_vm *vm)
   mrbc_class_hash = mrbc_class_alloc(vm, "Hash", mrbc_class_object);
 
   mrbc_define_method(vm, mrbc_class_hash, "size", c_hash_size);
+  mrbc_define_method(vm, mrbc_class_hash, "length", c_hash_size);
+  mrbc_define_method(vm, mrbc_class_hash, "empty?", c_hash_empty);
   mrbc_define_method(vm, mrbc_class_hash, "[]", c_hash_get);
   mrbc_define_method(vm, mrbc_class_hash, "[]=", c_hash_set);
-
+  mrbc_define_method(vm, mrbc_class_hash, "key?", c_hash_has_key);
+  mrbc_define_method(vm, mrbc_class_hash, "has_key?", c_hash_has_key);
+  mrbc_define_method(vm, mrbc_class_hash, "include?", c_hash_has_key);
+  mrbc_define_method(vm, mrbc_class_hash, "member?", c_hash_has_key);
+  mrbc_define_method(vm, mrbc_class_hash, "delete", c_hash_delete);
+  mrbc_define_method(vm, mrbc_class_hash, "keys", c_hash_keys);
+  mrbc_define_method(vm, mrbc_class_hash, "values", c_hash_values);
+  mrbc_define_method(vm, mrbc_class_hash, "each", c_hash_each);
+  mrbc_define_method(vm, mrbc_class_hash, "each_pair", c_hash_each);
+  mrbc_define_method(vm, mrbc_class_hash, "map", c_hash_map);
+  mrbc_define_method(vm, mrbc_class_hash, "collect", c_hash_map);
+  mrbc_define_method(vm, mrbc_class_hash, "select", c_hash_select);
+  mrbc_define_method(vm, mrbc_class_hash, "reject", c_hash_reject);
+  mrbc_define_method(vm, mrbc_class_hash, "count", c_hash_count);
 }
@@ -15,6 +15,7 @@
 #ifndef MRBC_SRC_C_HASH_H_
 #define MRBC_SRC_C_HASH_H_
 
+#include <stdint.h>
 #include "vm.h"
 
 #ifdef __cplusplus
@@ -22,6 +23,38 @@ extern "C" {
 #endif
 
 
+/* hashes up to this capacity have no index table */
+#ifndef HASH_LINEAR_MAX
+#define HASH_LINEAR_MAX 8
+#endif
+
+
+//================================================================
+/*!@brief
+  Hash
+
+  Entries are stored in insertion order. A deleted entry keeps its
+  slot, with key.tt == MRB_TT_EMPTY, until the next resize.
+  Small hashes have no index table, and are searched linearly.
+  If all keys of a small hash are Symbol, the symbol ids are also
+  packed in sym_keys, and searched without touching the entries.
+*/
+typedef struct RHash {
+  uint16_t count;	//!< num of entries
+  uint16_t used;	//!< num of used entry slots, deleted ones included
+  uint16_t capa;	//!< num of entry slots
+  uint16_t index_size;	//!< size of index table (power of 2), or 0
+  int16_t *index;	//!< entry number, or HASH_INDEX_EMPTY/DELETED
+  mrb_value *entries;	//!< key and value pairs
+  uint8_t flag_sym_keys;		//!< sym_keys is valid
+  mrb_sym sym_keys[HASH_LINEAR_MAX];	//!< symbol id of keys, or -1
+} mrb_hash;
+
+
+mrb_value mrbc_hash_new(mrb_vm *vm, int capa);
+mrb_value *mrbc_hash_get(mrb_value *hash, mrb_value *key);
+int mrbc_hash_set(mrb_vm *vm, mrb_value *hash, mrb_value *key, mrb_value *val);
+mrb_value mrbc_hash_remove(mrb_value *hash, mrb_value *key);
 void mrbc_init_class_hash(mrb_vm *vm);
 
 
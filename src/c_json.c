@@ -0,0 +1,933 @@
+/*! @file
+  @brief
+  JSON generator and parser.
+
+  <pre>
+  Copyright (C) 2015 Kyushu Institute of Technology.
+  Copyright (C) 2015 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  JSON.generate writes into one string buffer, grown by doubling.
+  JSON.parse is built on a push parser, which has no recursion and
+  keeps only the current token. Containers are made when they are
+  closed, in the exact size.
+  </pre>
+*/
+
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "c_json.h"
+#if MRBC_USE_FLOAT
+#include <stdio.h>
+#include <math.h>
+#endif
+
+#include "alloc.h"
+#include "class.h"
+#include "static.h"
+#include "value.h"
+#include "console.h"
+#include "symbol.h"
+#include "c_hash.h"
+#include "c_string.h"
+
+#define JSON_ERR_SYNTAX  (-1)
+#define JSON_ERR_DEPTH   (-2)
+#define JSON_ERR_NOMEM   (-3)
+
+// parser state
+enum {
+  JSON_ST_VALUE,		// expect a value
+  JSON_ST_VALUE_OR_END,		// after '['
+  JSON_ST_KEY,			// after ',' in object
+  JSON_ST_KEY_OR_END,		// after '{'
+  JSON_ST_COLON,		// after key
+  JSON_ST_NEXT,			// after value in container
+  JSON_ST_DONE,			// top level value is done
+  JSON_ST_STRING,
+  JSON_ST_ESCAPE,
+  JSON_ST_UNICODE,
+  JSON_ST_NUMBER,
+  JSON_ST_LITERAL,
+  JSON_ST_ERROR,
+};
+
+
+// Internal use only
+// write data to writer
+static void json_write(mrbc_json_writer *w, const char *s, int len)
+{
+  if( w->error ) return;
+
+  if( w->flush ){
+    while( w->len + len > w->size ){
+      int n = w->size - w->len;
+      memcpy(w->buf + w->len, s, n);
+      w->flush(w->arg, w->buf, w->size);
+      w->len = 0;
+      s += n;
+      len -= n;
+    }
+
+  } else if( w->len + len >= w->size ){
+    int size = w->size;
+    while( w->len + len >= size ) size *= 2;
+    char *buf = (char *)mrbc_realloc(w->vm, w->buf, size);
+    if( buf == NULL ){  // ENOMEM
+      w->error = JSON_ERR_NOMEM;
+      return;
+    }
+    w->buf = buf;
+    w->size = size;
+  }
+
+  memcpy(w->buf + w->len, s, len);
+  w->len += len;
+}
+
+
+// Internal use only
+// write string with quote and escape
+static void json_write_string(mrbc_json_writer *w, const char *s, int len)
+{
+  static const char hex[] = "0123456789abcdef";
+  const char *end = s + len;
+  const char *run = s;
+
+  json_write(w, "\"", 1);
+  for( ; s < end ; s++ ){
+    uint8_t ch = *s;
+    if( ch >= 0x20 && ch != '"' && ch != '\\' ) continue;
+
+    char esc[6] = { '\\', ch, '0', '0', hex[ch >> 4], hex[ch & 15] };
+    int n = 2;
+    switch( ch ){
+    case '\b': esc[1] = 'b'; break;
+    case '\f': esc[1] = 'f'; break;
+    case '\n': esc[1] = 'n'; break;
+    case '\r': esc[1] = 'r'; break;
+    case '\t': esc[1] = 't'; break;
+    case '"':
+    case '\\': break;
+    default:
+      esc[1] = 'u';
+      n = 6;
+      break;
+    }
+    json_write(w, run, s - run);
+    json_write(w, esc, n);
+    run = s + 1;
+  }
+  json_write(w, run, end - run);
+  json_write(w, "\"", 1);
+}
+
+
+// Internal use only
+// write number
+static void json_write_number(mrbc_json_writer *w, mrb_value *v)
+{
+  char buf[32];
+  int len;
+
+#if MRBC_USE_FLOAT
+  if( v->tt == MRB_TT_FLOAT ){
+    if( !isfinite(v->d) ){
+      json_write(w, "null", 4);
+      return;
+    }
+    // shortest of 15 or 17 digits, that reads back the same.
+    len = snprintf(buf, sizeof(buf), "%.15g", v->d);
+    if( strtod(buf, NULL) != v->d ){
+      len = snprintf(buf, sizeof(buf), "%.17g", v->d);
+    }
+    if( strpbrk(buf, ".en") == NULL ){
+      buf[len++] = '.';
+      buf[len++] = '0';
+    }
+    json_write(w, buf, len);
+    return;
+  }
+#endif
+
+  mrbc_format_out out;
+  mrbc_format_spec spec = { 'd', ' ', 1, 0, -1 };
+  mrbc_format_init(&out, buf, sizeof(buf));
+  mrbc_format_int(&out, v->i, 10, &spec);
+  json_write(w, buf, out.len);
+}
+
+
+// Internal use only
+// write value
+static void json_write_value(mrbc_json_writer *w, mrb_value *v, int depth)
+{
+  int i, n;
+
+  if( depth > JSON_MAX_DEPTH ){
+    w->error = JSON_ERR_DEPTH;
+    return;
+  }
+
+  switch( v->tt ){
+  case MRB_TT_TRUE:
+    json_write(w, "true", 4);
+    break;
+
+  case MRB_TT_FALSE:
+    json_write(w, "false", 5);
+    break;
+
+  case MRB_TT_FIXNUM:
+#if MRBC_USE_FLOAT
+  case MRB_TT_FLOAT:
+#endif
+    json_write_number(w, v);
+    break;
+
+  case MRB_TT_SYMBOL: {
+    const char *s = symid_to_str(v->i);
+    json_write_string(w, s, strlen(s));
+  } break;
+
+  case MRB_TT_STRING:
+    json_write_string(w, v->str, strlen(v->str));
+    break;
+
+  case MRB_TT_ARRAY:
+    json_write(w, "[", 1);
+    n = v->array[0].i;
+    for( i = 1 ; i <= n ; i++ ){
+      if( i > 1 ) json_write(w, ",", 1);
+      json_write_value(w, &v->array[i], depth + 1);
+    }
+    json_write(w, "]", 1);
+    break;
+
+  case MRB_TT_HASH: {
+    mrb_hash *h = v->hash;
+    int first = 1;
+    json_write(w, "{", 1);
+    for( i = 0 ; i < h->used ; i++ ){
+      mrb_value *key = &h->entries[i*2];
+      if( key->tt == MRB_TT_EMPTY ) continue;
+      if( !first ) json_write(w, ",", 1);
+      first = 0;
+
+      if( key->tt == MRB_TT_STRING || key->tt == MRB_TT_SYMBOL ){
+	json_write_value(w, key, depth + 1);
+      } else {
+	// other keys are written in quotes. {1=>2} to {"1":2}
+	json_write(w, "\"", 1);
+	json_write_value(w, key, depth + 1);
+	json_write(w, "\"", 1);
+      }
+      json_write(w, ":", 1);
+      json_write_value(w, key + 1, depth + 1);
+    }
+    json_write(w, "}", 1);
+  } break;
+
+  default:
+    json_write(w, "null", 4);
+    break;
+  }
+}
+
+
+//================================================================
+/*! initialize JSON writer
+
+  @param  w	writer
+  @param  vm	pointer to VM.
+  @param  buf	output buffer, or NULL to allocate a string buffer.
+  @param  size	size of buf.
+  @param  flush	function called when buf is full, or NULL.
+  @param  arg	argument for flush.
+*/
+void mrbc_json_writer_init(mrbc_json_writer *w, mrb_vm *vm, char *buf, int size, void (*flush)(void *, const char *, int), void *arg)
+{
+  w->vm = vm;
+  w->buf = buf;
+  w->len = 0;
+  w->size = size;
+  w->flush = flush;
+  w->arg = arg;
+  w->error = 0;
+
+  if( buf == NULL ){
+    w->size = 32;
+    w->buf = (char *)mrbc_alloc(vm, w->size);
+    if( w->buf == NULL ){
+      w->error = JSON_ERR_NOMEM;
+      return;
+    }
+    mrbc_set_tt(w->buf, MRB_TT_STRING);
+  }
+}
+
+
+//================================================================
+/*! write a value as JSON
+
+  In streaming mode, the rest in the buffer is also flushed.
+
+  @param  w	writer
+  @param  v	value
+  @return	0 if no error.
+*/
+int mrbc_json_write(mrbc_json_writer *w, mrb_value *v)
+{
+  json_write_value(w, v, 0);
+  if( w->flush && !w->error && w->len ){
+    w->flush(w->arg, w->buf, w->len);
+    w->len = 0;
+  }
+  return w->error;
+}
+
+
+//================================================================
+/*! generate JSON string
+
+  @param  vm	pointer to VM.
+  @param  v	value
+  @return	new string, or NULL if error.
+*/
+char *mrbc_json_generate(mrb_vm *vm, mrb_value *v)
+{
+  mrbc_json_writer w;
+
+  mrbc_json_writer_init(&w, vm, NULL, 0, NULL, NULL);
+  json_write_value(&w, v, 0);
+  if( w.error ){
+    if( w.buf ) mrbc_free(vm, w.buf);
+    return NULL;
+  }
+
+  w.buf[w.len] = 0;
+  return (char *)mrbc_realloc(vm, w.buf, w.len + 1);
+}
+
+
+
+// Internal use only
+// add bytes to token
+static int json_tok_add(mrbc_json_parser *p, const char *s, int len)
+{
+  if( p->tok_len + len >= p->tok_size ){
+    int size = p->tok_size ? p->tok_size : 32;
+    while( p->tok_len + len >= size ) size *= 2;
+    char *tok = (char *)(p->tok ? mrbc_realloc(p->vm, p->tok, size)
+				: mrbc_alloc(p->vm, size));
+    if( tok == NULL ) return JSON_ERR_NOMEM;
+    p->tok = tok;
+    p->tok_size = size;
+  }
+
+  memcpy(p->tok + p->tok_len, s, len);
+  p->tok_len += len;
+  p->tok[p->tok_len] = 0;
+  return 0;
+}
+
+
+// Internal use only
+// add code point to token as UTF-8
+static int json_tok_add_utf8(mrbc_json_parser *p, uint32_t cp)
+{
+  char buf[4];
+  int n;
+
+  if( cp < 0x80 ){
+    buf[0] = cp;
+    n = 1;
+  } else if( cp < 0x800 ){
+    buf[0] = 0xc0 | (cp >> 6);
+    buf[1] = 0x80 | (cp & 0x3f);
+    n = 2;
+  } else if( cp < 0x10000 ){
+    buf[0] = 0xe0 | (cp >> 12);
+    buf[1] = 0x80 | ((cp >> 6) & 0x3f);
+    buf[2] = 0x80 | (cp & 0x3f);
+    n = 3;
+  } else {
+    buf[0] = 0xf0 | (cp >> 18);
+    buf[1] = 0x80 | ((cp >> 12) & 0x3f);
+    buf[2] = 0x80 | ((cp >> 6) & 0x3f);
+    buf[3] = 0x80 | (cp & 0x3f);
+    n = 4;
+  }
+  return json_tok_add(p, buf, n);
+}
+
+
+// Internal use only
+// check number token
+// returns 1 if integer, 2 if float, or 0 if invalid.
+static int json_check_number(const char *s)
+{
+  int ret = 1;
+
+  if( *s == '-' ) s++;
+  if( *s == '0' ){
+    s++;
+  } else if( *s >= '1' && *s <= '9' ){
+    while( *s >= '0' && *s <= '9' ) s++;
+  } else {
+    return 0;
+  }
+
+  if( *s == '.' ){
+    s++;
+    if( !(*s >= '0' && *s <= '9') ) return 0;
+    while( *s >= '0' && *s <= '9' ) s++;
+    ret = 2;
+  }
+
+  if( *s == 'e' || *s == 'E' ){
+    s++;
+    if( *s == '+' || *s == '-' ) s++;
+    if( !(*s >= '0' && *s <= '9') ) return 0;
+    while( *s >= '0' && *s <= '9' ) s++;
+    ret = 2;
+  }
+
+  return *s ? 0 : ret;
+}
+
+
+// Internal use only
+// a value is done. next state.
+static inline void json_value_done(mrbc_json_parser *p)
+{
+  p->state = p->depth ? JSON_ST_NEXT : JSON_ST_DONE;
+}
+
+
+// Internal use only
+// number token is done.
+static int json_number_done(mrbc_json_parser *p)
+{
+  int type = p->tok_len ? json_check_number(p->tok) : 0;
+  int event = JSON_EV_INT;
+
+  if( type == 0 ) return JSON_ERR_SYNTAX;
+  if( type == 1 && mrbc_string_to_i(p->tok, 10, 1, &p->ival) == 0 ){
+    // integer
+  } else {
+#if MRBC_USE_FLOAT
+    p->dval = mrbc_string_to_f(p->tok);
+    event = JSON_EV_FLOAT;
+#else
+    return JSON_ERR_SYNTAX;
+#endif
+  }
+
+  json_value_done(p);
+  return p->handler(p, event);
+}
+
+
+// Internal use only
+// start a value. returns error code.
+static int json_value_begin(mrbc_json_parser *p, int ch)
+{
+  switch( ch ){
+  case '[':
+  case '{':
+    if( p->depth >= JSON_MAX_DEPTH ) return JSON_ERR_DEPTH;
+    p->stack[p->depth++] = ch;
+    p->state = (ch == '[') ? JSON_ST_VALUE_OR_END : JSON_ST_KEY_OR_END;
+    return p->handler(p, (ch == '[') ? JSON_EV_ARRAY_BEGIN : JSON_EV_OBJECT_BEGIN);
+
+  case '"':
+    p->is_key = 0;
+    p->tok_len = 0;
+    p->state = JSON_ST_STRING;
+    return json_tok_add(p, "", 0);
+
+  case 't': p->literal = "true";  break;
+  case 'f': p->literal = "false"; break;
+  case 'n': p->literal = "null";  break;
+
+  default:
+    if( ch == '-' || (ch >= '0' && ch <= '9') ){
+      char c = ch;
+      p->tok_len = 0;
+      p->state = JSON_ST_NUMBER;
+      return json_tok_add(p, &c, 1);
+    }
+    return JSON_ERR_SYNTAX;
+  }
+
+  // true, false or null
+  p->lit_pos = 1;
+  p->state = JSON_ST_LITERAL;
+  return 0;
+}
+
+
+// Internal use only
+// close array or object
+static int json_close(mrbc_json_parser *p, int ch)
+{
+  if( p->depth == 0 || p->stack[p->depth-1] != (ch == ']' ? '[' : '{') ){
+    return JSON_ERR_SYNTAX;
+  }
+  p->depth--;
+  json_value_done(p);
+  return p->handler(p, (ch == ']') ? JSON_EV_ARRAY_END : JSON_EV_OBJECT_END);
+}
+
+
+// Internal use only
+// process one escaped character
+static int json_escape(mrbc_json_parser *p, int ch)
+{
+  static const char esc_from[] = "\"\\/bfnrt";
+  static const char esc_to[]   = "\"\\/\b\f\n\r\t";
+
+  if( ch == 'u' ){
+    p->hex_cnt = 0;
+    p->u_val = 0;
+    p->state = JSON_ST_UNICODE;
+    return 0;
+  }
+  if( p->u_high ) return JSON_ERR_SYNTAX;	// high surrogate only
+
+  const char *s = strchr(esc_from, ch);
+  if( ch == 0 || s == NULL ) return JSON_ERR_SYNTAX;
+  p->state = JSON_ST_STRING;
+  return json_tok_add(p, &esc_to[s - esc_from], 1);
+}
+
+
+// Internal use only
+// process one hex digit of \uXXXX
+static int json_unicode(mrbc_json_parser *p, int ch)
+{
+  int d;
+  if( ch >= '0' && ch <= '9' ) d = ch - '0';
+  else if( ch >= 'a' && ch <= 'f' ) d = ch - 'a' + 10;
+  else if( ch >= 'A' && ch <= 'F' ) d = ch - 'A' + 10;
+  else return JSON_ERR_SYNTAX;
+
+  p->u_val = (p->u_val << 4) | d;
+  if( ++p->hex_cnt < 4 ) return 0;
+
+  uint32_t u = p->u_val;
+  p->state = JSON_ST_STRING;
+
+  if( p->u_high ){
+    if( u < 0xdc00 || u > 0xdfff ) return JSON_ERR_SYNTAX;
+    u = 0x10000 + ((p->u_high - 0xd800) << 10) + (u - 0xdc00);
+    p->u_high = 0;
+  } else if( u >= 0xd800 && u <= 0xdbff ){
+    p->u_high = u;
+    return 0;
+  } else if( u >= 0xdc00 && u <= 0xdfff ){
+    return JSON_ERR_SYNTAX;
+  }
+  return json_tok_add_utf8(p, u);
+}
+
+
+//================================================================
+/*! initialize JSON parser
+
+  @param  p		parser
+  @param  vm		pointer to VM, which owns the token buffer.
+  @param  handler	function called for each event. returns 0 to continue.
+  @param  arg		argument for handler.
+*/
+void mrbc_json_parser_init(mrbc_json_parser *p, mrb_vm *vm, int (*handler)(mrbc_json_parser *, int), void *arg)
+{
+  memset(p, 0, sizeof(mrbc_json_parser));
+  p->vm = vm;
+  p->state = JSON_ST_VALUE;
+  p->handler = handler;
+  p->arg = arg;
+}
+
+
+//================================================================
+/*! feed data to JSON parser
+
+  @param  p	parser
+  @param  s	data
+  @param  len	length of data
+  @return	0 if no error, or error code.
+		position of error is in p->pos.
+*/
+int mrbc_json_parser_feed(mrbc_json_parser *p, const char *s, int len)
+{
+  const char *start = s;
+  const char *end = s + len;
+  int ret = 0;
+
+  if( p->state == JSON_ST_ERROR ) return JSON_ERR_SYNTAX;
+
+  while( s < end && ret == 0 ){
+    int ch = (uint8_t)*s;
+
+    switch( p->state ){
+    case JSON_ST_STRING: {
+      // copy a run of plain characters at once.
+      const char *q = s;
+      while( q < end && *q != '"' && *q != '\\' && (uint8_t)*q >= 0x20 ) q++;
+      if( q != s ){
+	if( p->u_high ){
+	  ret = JSON_ERR_SYNTAX;
+	  break;
+	}
+	ret = json_tok_add(p, s, q - s);
+	s = q;
+	continue;
+      }
+      if( ch == '\\' ){
+	p->state = JSON_ST_ESCAPE;
+      } else if( ch == '"' && !p->u_high ){
+	if( p->is_key ){
+	  p->state = JSON_ST_COLON;
+	  ret = p->handler(p, JSON_EV_KEY);
+	} else {
+	  json_value_done(p);
+	  ret = p->handler(p, JSON_EV_STRING);
+	}
+      } else {
+	ret = JSON_ERR_SYNTAX;
+      }
+    } break;
+
+    case JSON_ST_ESCAPE:
+      ret = json_escape(p, ch);
+      break;
+
+    case JSON_ST_UNICODE:
+      ret = json_unicode(p, ch);
+      break;
+
+    case JSON_ST_NUMBER:
+      if( (ch >= '0' && ch <= '9') || ch == '.' || ch == 'e' || ch == 'E' ||
+	  ch == '+' || ch == '-' ){
+	char c = ch;
+	ret = json_tok_add(p, &c, 1);
+      } else {
+	ret = json_number_done(p);
+	continue;	// the character is not consumed.
+      }
+      break;
+
+    case JSON_ST_LITERAL:
+      if( ch != p->literal[p->lit_pos++] ){
+	ret = JSON_ERR_SYNTAX;
+	break;
+      }
+      if( p->literal[p->lit_pos] == 0 ){
+	json_value_done(p);
+	ret = p->handler(p, p->literal[0] == 't' ? JSON_EV_TRUE :
+			    p->literal[0] == 'f' ? JSON_EV_FALSE : JSON_EV_NULL);
+      }
+      break;
+
+    default:
+      if( ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r' ) break;
+
+      switch( p->state ){
+      case JSON_ST_VALUE_OR_END:
+	if( ch == ']' ){
+	  ret = json_close(p, ch);
+	  break;
+	}
+	// fall through.
+      case JSON_ST_VALUE:
+	ret = json_value_begin(p, ch);
+	break;
+
+      case JSON_ST_KEY_OR_END:
+	if( ch == '}' ){
+	  ret = json_close(p, ch);
+	  break;
+	}
+	// fall through.
+      case JSON_ST_KEY:
+	if( ch != '"' ){
+	  ret = JSON_ERR_SYNTAX;
+	  break;
+	}
+	ret = json_value_begin(p, ch);
+	p->is_key = 1;
+	break;
+
+      case JSON_ST_COLON:
+	if( ch == ':' ){
+	  p->state = JSON_ST_VALUE;
+	} else {
+	  ret = JSON_ERR_SYNTAX;
+	}
+	break;
+
+      case JSON_ST_NEXT:
+	if( ch == ',' ){
+	  p->state = (p->stack[p->depth-1] == '[') ? JSON_ST_VALUE : JSON_ST_KEY;
+	} else if( ch == ']' || ch == '}' ){
+	  ret = json_close(p, ch);
+	} else {
+	  ret = JSON_ERR_SYNTAX;
+	}
+	break;
+
+      default:	// JSON_ST_DONE
+	ret = JSON_ERR_SYNTAX;
+	break;
+      }
+    }
+    if( ret != 0 ) break;
+    s++;
+  }
+
+  if( ret != 0 ){
+    p->state = JSON_ST_ERROR;
+    p->pos += s - start;
+    return ret;
+  }
+  p->pos += len;
+  return 0;
+}
+
+
+//================================================================
+/*! end of data
+
+  @param  p	parser
+  @return	0 if a complete value was parsed, or error code.
+*/
+int mrbc_json_parser_finish(mrbc_json_parser *p)
+{
+  int ret = 0;
+
+  if( p->state == JSON_ST_NUMBER ){
+    ret = json_number_done(p);
+  }
+  if( ret == 0 && p->state != JSON_ST_DONE ){
+    ret = JSON_ERR_SYNTAX;
+  }
+  if( ret != 0 ) p->state = JSON_ST_ERROR;
+  return ret;
+}
+
+
+//================================================================
+/*! release resources of JSON parser
+
+  @param  p	parser
+*/
+void mrbc_json_parser_close(mrbc_json_parser *p)
+{
+  if( p->tok ) mrbc_free(p->vm, p->tok);
+  p->tok = NULL;
+  p->tok_size = 0;
+}
+
+
+
+// Internal use only
+// object builder for mrbc_json_parse()
+typedef struct JSON_BUILDER {
+  mrb_value *stack;		// values not yet in a container
+  int top;
+  int size;
+  uint16_t start[JSON_MAX_DEPTH];	// start of each container in stack
+} json_builder;
+
+
+// Internal use only
+// push a value to builder stack
+static int json_build_push(mrbc_json_parser *p, mrb_value *v)
+{
+  json_builder *b = (json_builder *)p->arg;
+
+  if( b->top >= b->size ){
+    int size = b->size ? b->size * 2 : 16;
+    mrb_value *stack = (mrb_value *)(b->stack ?
+		mrbc_realloc(p->vm, b->stack, sizeof(mrb_value) * size) :
+		mrbc_alloc(p->vm, sizeof(mrb_value) * size));
+    if( stack == NULL ) return JSON_ERR_NOMEM;
+    b->stack = stack;
+    b->size = size;
+  }
+
+  b->stack[b->top++] = *v;
+  return 0;
+}
+
+
+// Internal use only
+// parser event handler to build objects
+static int json_build_handler(mrbc_json_parser *p, int event)
+{
+  json_builder *b = (json_builder *)p->arg;
+  mrb_value v;
+  int i, n;
+
+  switch( event ){
+  case JSON_EV_NULL:	v.tt = MRB_TT_NIL;	break;
+  case JSON_EV_TRUE:	v.tt = MRB_TT_TRUE;	break;
+  case JSON_EV_FALSE:	v.tt = MRB_TT_FALSE;	break;
+
+  case JSON_EV_INT:
+    v.tt = MRB_TT_FIXNUM;
+    v.i = p->ival;
+    break;
+
+#if MRBC_USE_FLOAT
+  case JSON_EV_FLOAT:
+    v.tt = MRB_TT_FLOAT;
+    v.d = p->dval;
+    break;
+#endif
+
+  case JSON_EV_STRING:
+  case JSON_EV_KEY:
+    v.tt = MRB_TT_STRING;
+    v.str = (char *)mrbc_alloc(p->vm, p->tok_len + 1);
+    if( v.str == NULL ) return JSON_ERR_NOMEM;
+    mrbc_set_tt(v.str, MRB_TT_STRING);
+    memcpy(v.str, p->tok, p->tok_len + 1);
+    break;
+
+  case JSON_EV_ARRAY_BEGIN:
+  case JSON_EV_OBJECT_BEGIN:
+    b->start[p->depth - 1] = b->top;
+    return 0;
+
+  case JSON_EV_ARRAY_END: {
+    n = b->top - b->start[p->depth];
+    mrb_value *array = (mrb_value *)mrbc_alloc(p->vm, sizeof(mrb_value) * (n+1));
+    if( array == NULL ) return JSON_ERR_NOMEM;
+    mrbc_set_tt(array, MRB_TT_ARRAY);
+    array[0].tt = MRB_TT_FIXNUM;
+    array[0].i = n;
+    b->top -= n;
+    memcpy(array + 1, b->stack + b->top, sizeof(mrb_value) * n);
+    v.tt = MRB_TT_ARRAY;
+    v.array = array;
+  } break;
+
+  case JSON_EV_OBJECT_END:
+    n = (b->top - b->start[p->depth]) / 2;
+    v = mrbc_hash_new(p->vm, n);
+    if( v.hash == NULL ) return JSON_ERR_NOMEM;
+    for( i = 0 ; i < n ; i++ ){
+      mrb_value *kv = b->stack + b->top - (n - i) * 2;
+      mrb_value *old = mrbc_hash_get(&v, kv);
+      if( old ){		// duplicated key. the last one wins.
+	mrbc_release(p->vm, old);
+	mrbc_release(p->vm, kv);
+	*old = kv[1];
+      } else if( mrbc_hash_set(p->vm, &v, kv, kv + 1) != 0 ){
+	mrbc_release(p->vm, &v);
+	return JSON_ERR_NOMEM;	// rest of pairs are released by caller.
+      }
+      kv[0].tt = kv[1].tt = MRB_TT_NIL;	// now owned by the hash.
+    }
+    b->top -= n * 2;
+    break;
+
+  default:
+    return JSON_ERR_SYNTAX;
+  }
+
+  int ret = json_build_push(p, &v);
+  if( ret != 0 ) mrbc_release(p->vm, &v);
+  return ret;
+}
+
+
+//================================================================
+/*! parse JSON string
+
+  @param  vm	pointer to VM.
+  @param  s	JSON string
+  @param  len	length of s
+  @return	value. MRB_TT_EMPTY if error.
+*/
+mrb_value mrbc_json_parse(mrb_vm *vm, const char *s, int len)
+{
+  mrbc_json_parser p;
+  json_builder b;
+  mrb_value ret;
+
+  memset(&b, 0, sizeof(b));
+  mrbc_json_parser_init(&p, vm, json_build_handler, &b);
+
+  int err = mrbc_json_parser_feed(&p, s, len);
+  if( err == 0 ) err = mrbc_json_parser_finish(&p);
+
+  if( err == 0 ){
+    ret = b.stack[0];
+  } else {
+    while( b.top > 0 ){
+      mrbc_release(vm, &b.stack[--b.top]);
+    }
+    ret.tt = MRB_TT_EMPTY;
+    if( err == JSON_ERR_DEPTH ){
+      console_printf("JSON::NestingError: nesting is too deep\n");
+    } else if( err == JSON_ERR_NOMEM ){
+      console_printf("NoMemoryError: JSON.parse\n");
+    } else {
+      console_printf("JSON::ParserError: unexpected token at %d\n", p.pos);
+    }
+  }
+
+  mrbc_json_parser_close(&p);
+  if( b.stack ) mrbc_free(vm, b.stack);
+  return ret;
+}
+
+
+
+// method
+// JSON.generate
+static void c_json_generate(mrb_vm *vm, mrb_value *v)
+{
+  char *str = mrbc_json_generate(vm, v + 1);
+  if( str == NULL ){
+    console_printf("JSON::GeneratorError: can't generate JSON\n");
+    SET_NIL_RETURN();
+    return;
+  }
+  v->tt = MRB_TT_STRING;
+  v->str = str;
+}
+
+
+// method
+// JSON.parse
+static void c_json_parse(mrb_vm *vm, mrb_value *v)
+{
+  if( v[1].tt != MRB_TT_STRING ){
+    console_printf("TypeError: no implicit conversion into String\n");
+    SET_NIL_RETURN();
+    return;
+  }
+
+  mrb_value ret = mrbc_json_parse(vm, v[1].str, strlen(v[1].str));
+  if( ret.tt == MRB_TT_EMPTY ) ret.tt = MRB_TT_NIL;
+  v[0] = ret;
+}
+
+
+
+// init class
+void mrbc_init_class_json(mrb_vm *vm)
+{
+  mrb_class *cls = mrbc_class_alloc(vm, "JSON", mrbc_class_object);
+
+  mrbc_define_method(vm, cls, "generate", c_json_generate);
+  mrbc_define_method(vm, cls, "parse", c_json_parse);
+}
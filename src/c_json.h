@@ -0,0 +1,121 @@
+/*! @file
+  @brief
+  JSON generator and parser.
+
+  <pre>
+  Copyright (C) 2015 Kyushu Institute of Technology.
+  Copyright (C) 2015 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+
+  </pre>
+*/
+
+#ifndef MRBC_SRC_C_JSON_H_
+#define MRBC_SRC_C_JSON_H_
+
+#include <stdint.h>
+#include "vm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* maximum nesting of arrays and objects */
+#ifndef JSON_MAX_DEPTH
+#define JSON_MAX_DEPTH 32
+#endif
+
+
+//================================================================
+/*!@brief
+  JSON writer
+
+  Output goes to a string buffer, which grows as needed.
+  If flush is given, buf is a fixed size buffer given by the caller,
+  and flush is called each time it is full. (streaming mode)
+*/
+typedef struct RJsonWriter {
+  mrb_vm *vm;
+  char *buf;		//!< output buffer
+  int   len;		//!< length of output in buf
+  int   size;		//!< buffer size
+  void (*flush)(void *arg, const char *s, int len);
+  void *arg;		//!< argument for flush
+  int   error;		//!< 0 if no error
+} mrbc_json_writer;
+
+
+//================================================================
+/*!@brief
+  events from JSON parser
+*/
+enum JSON_EVENT {
+  JSON_EV_NULL,
+  JSON_EV_TRUE,
+  JSON_EV_FALSE,
+  JSON_EV_INT,		//!< value in ival
+  JSON_EV_FLOAT,	//!< value in dval
+  JSON_EV_STRING,	//!< string in tok, tok_len
+  JSON_EV_KEY,		//!< object key in tok, tok_len
+  JSON_EV_ARRAY_BEGIN,
+  JSON_EV_ARRAY_END,
+  JSON_EV_OBJECT_BEGIN,
+  JSON_EV_OBJECT_END,
+};
+
+
+//================================================================
+/*!@brief
+  JSON parser
+
+  Push style parser. Input can be given in any size of chunks, and
+  each value is notified to the handler as an event, without building
+  objects. So data larger than memory pool can be processed.
+*/
+typedef struct RJsonParser {
+  mrb_vm *vm;
+  uint8_t state;
+  uint8_t depth;
+  uint8_t is_key;	//!< string in parsing is an object key
+  uint8_t lit_pos;	//!< matched length of true/false/null
+  const char *literal;	//!< literal in parsing
+  uint8_t hex_cnt;	//!< num of hex digits of \uXXXX
+  uint16_t u_val;	//!< value of \uXXXX
+  uint16_t u_high;	//!< pending high surrogate, or 0
+  char stack[JSON_MAX_DEPTH];	//!< '[' or '{'
+
+  char *tok;		//!< string or number token
+  int   tok_len;
+  int   tok_size;
+
+  int32_t ival;
+#if MRBC_USE_FLOAT
+  double  dval;
+#endif
+
+  int   pos;		//!< num of bytes processed
+  int (*handler)(struct RJsonParser *p, int event);
+  void *arg;		//!< argument for handler
+} mrbc_json_parser;
+
+
+void mrbc_json_writer_init(mrbc_json_writer *w, mrb_vm *vm, char *buf, int size, void (*flush)(void *, const char *, int), void *arg);
+int mrbc_json_write(mrbc_json_writer *w, mrb_value *v);
+char *mrbc_json_generate(mrb_vm *vm, mrb_value *v);
+
+void mrbc_json_parser_init(mrbc_json_parser *p, mrb_vm *vm, int (*handler)(mrbc_json_parser *, int), void *arg);
+int mrbc_json_parser_feed(mrbc_json_parser *p, const char *s, int len);
+int mrbc_json_parser_finish(mrbc_json_parser *p);
+void mrbc_json_parser_close(mrbc_json_parser *p);
+mrb_value mrbc_json_parse(mrb_vm *vm, const char *s, int len);
+
+void mrbc_init_class_json(mrb_vm *vm);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,301 @@
+/*! @file
+  @brief
+  Math module.
+
+  <pre>
+  Copyright (C) 2015 Kyushu Institute of Technology.
+  Copyright (C) 2015 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  Scalar functions take Fixnum or Float, and return Float.
+  Bulk functions (Math.sqrt_all etc.) take an Array of numbers, and
+  replace each element with the result in place. Elements are copied
+  to a small double buffer, so that the loop over the buffer is
+  a plain call of libm, which can be vectorized by the compiler.
+  Bulk functions do not check the domain; such element becomes NaN.
+  </pre>
+*/
+
+#include "vm_config.h"
+#include <math.h>
+
+#include "c_math.h"
+#include "class.h"
+#include "static.h"
+#include "value.h"
+#include "console.h"
+
+#if MRBC_USE_FLOAT && MRBC_USE_MATH
+
+/* num of elements processed at a time, by bulk functions */
+#ifndef MATH_BULK_CHUNK
+#define MATH_BULK_CHUNK 32
+#endif
+
+
+// Internal use only
+// get argument as double. returns 0 if error.
+static int math_get_arg(mrb_value *v, double *d)
+{
+  switch( v->tt ){
+  case MRB_TT_FIXNUM:
+    *d = v->i;
+    return 1;
+
+  case MRB_TT_FLOAT:
+    *d = v->d;
+    return 1;
+
+  default:
+    console_printf("TypeError: can't convert into Float\n");
+    return 0;
+  }
+}
+
+
+// Internal use only
+static void math_domain_error(const char *name)
+{
+  console_printf("Math::DomainError: Numerical argument is out of domain - \"%s\"\n", name);
+}
+
+
+// Internal use only
+// define a method of one argument.
+//  domain is the condition of x, which is a valid argument.
+#define MATH_FUNC1(func, domain)				\
+static void c_math_##func(mrb_vm *vm, mrb_value *v)		\
+{								\
+  double x;							\
+  if( !math_get_arg(&v[1], &x) ) goto L_ERROR;			\
+  if( !(domain) ){						\
+    math_domain_error(#func);					\
+    goto L_ERROR;						\
+  }								\
+  SET_FLOAT_RETURN( func(x) );					\
+  return;							\
+								\
+ L_ERROR:							\
+  SET_NIL_RETURN();						\
+}
+
+// Internal use only
+// define a method of two arguments.
+#define MATH_FUNC2(func)					\
+static void c_math_##func(mrb_vm *vm, mrb_value *v)		\
+{								\
+  double x, y;							\
+  if( !math_get_arg(&v[1], &x) ) goto L_ERROR;			\
+  if( !math_get_arg(&v[2], &y) ) goto L_ERROR;			\
+  SET_FLOAT_RETURN( func(x, y) );				\
+  return;							\
+								\
+ L_ERROR:							\
+  SET_NIL_RETURN();						\
+}
+
+
+MATH_FUNC1( sqrt, !(x < 0) )
+MATH_FUNC1( cbrt, 1 )
+MATH_FUNC1( sin, 1 )
+MATH_FUNC1( cos, 1 )
+MATH_FUNC1( tan, 1 )
+MATH_FUNC1( asin, !(x < -1 || x > 1) )
+MATH_FUNC1( acos, !(x < -1 || x > 1) )
+MATH_FUNC1( atan, 1 )
+MATH_FUNC1( sinh, 1 )
+MATH_FUNC1( cosh, 1 )
+MATH_FUNC1( tanh, 1 )
+MATH_FUNC1( exp, 1 )
+MATH_FUNC1( log2, !(x < 0) )
+MATH_FUNC1( log10, !(x < 0) )
+MATH_FUNC2( atan2 )
+MATH_FUNC2( hypot )
+
+
+// method
+// Math.log
+//  log(x)
+//  log(x, base)
+static void c_math_log(mrb_vm *vm, mrb_value *v)
+{
+  double x, base;
+
+  if( !math_get_arg(&v[1], &x) ) goto L_ERROR;
+  if( x < 0 ) goto L_DOMAIN_ERROR;
+  if( mrbc_get_argc(vm) < 2 ){
+    SET_FLOAT_RETURN( log(x) );
+    return;
+  }
+
+  if( !math_get_arg(&v[2], &base) ) goto L_ERROR;
+  if( base < 0 ) goto L_DOMAIN_ERROR;
+  SET_FLOAT_RETURN( log(x) / log(base) );
+  return;
+
+ L_DOMAIN_ERROR:
+  math_domain_error("log");
+ L_ERROR:
+  SET_NIL_RETURN();
+}
+
+
+
+// Internal use only
+// check arguments of bulk function.
+//  all arguments are Arrays of numbers, in the same size,
+//  and the first one can be modified.
+static int math_bulk_check(mrb_value *v, int argc)
+{
+  int i, j;
+
+  for( i = 1 ; i <= argc ; i++ ){
+    if( v[i].tt != MRB_TT_ARRAY ){
+      console_printf("TypeError: Array required\n");
+      return 0;
+    }
+    for( j = 1 ; j <= v[i].array[0].i ; j++ ){
+      int tt = v[i].array[j].tt;
+      if( tt != MRB_TT_FIXNUM && tt != MRB_TT_FLOAT ){
+	console_printf("TypeError: can't convert into Float\n");
+	return 0;
+      }
+    }
+    if( v[i].array[0].i != v[1].array[0].i ){
+      console_printf("ArgumentError: Array size mismatch\n");
+      return 0;
+    }
+  }
+
+  if( mrbc_is_frozen_object(&v[1]) ){
+    console_printf("FrozenError: can't modify frozen Array\n");
+    return 0;
+  }
+
+  return 1;
+}
+
+
+// Internal use only
+// copy elements from pos to buf as double. returns num of elements.
+static int math_bulk_load(mrb_value *array, int pos, double *buf)
+{
+  int n = array[0].i - pos;
+  int i;
+
+  if( n > MATH_BULK_CHUNK ) n = MATH_BULK_CHUNK;
+  for( i = 0 ; i < n ; i++ ){
+    mrb_value *p = &array[pos + i + 1];
+    buf[i] = (p->tt == MRB_TT_FIXNUM) ? p->i : p->d;
+  }
+  return n;
+}
+
+
+// Internal use only
+// copy buf to elements from pos, as Float.
+static void math_bulk_store(mrb_value *array, int pos, int n, const double *buf)
+{
+  int i;
+
+  for( i = 0 ; i < n ; i++ ){
+    array[pos + i + 1].tt = MRB_TT_FLOAT;
+    array[pos + i + 1].d = buf[i];
+  }
+}
+
+
+// Internal use only
+// define a bulk method of one Array.
+#define MATH_BULK1(func)					\
+static void c_math_##func##_all(mrb_vm *vm, mrb_value *v)	\
+{								\
+  double buf[MATH_BULK_CHUNK];					\
+  int pos, n, i;						\
+								\
+  if( !math_bulk_check(v, 1) ){					\
+    SET_NIL_RETURN();						\
+    return;							\
+  }								\
+  for( pos = 0 ; pos < v[1].array[0].i ; pos += n ){		\
+    n = math_bulk_load(v[1].array, pos, buf);			\
+    for( i = 0 ; i < n ; i++ ){					\
+      buf[i] = func(buf[i]);					\
+    }								\
+    math_bulk_store(v[1].array, pos, n, buf);			\
+  }								\
+  v[0] = v[1];							\
+}
+
+// Internal use only
+// define a bulk method of two Arrays. result is stored to the first.
+#define MATH_BULK2(func)					\
+static void c_math_##func##_all(mrb_vm *vm, mrb_value *v)	\
+{								\
+  double buf[MATH_BULK_CHUNK], buf2[MATH_BULK_CHUNK];		\
+  int pos, n, i;						\
+								\
+  if( !math_bulk_check(v, 2) ){					\
+    SET_NIL_RETURN();						\
+    return;							\
+  }								\
+  for( pos = 0 ; pos < v[1].array[0].i ; pos += n ){		\
+    n = math_bulk_load(v[1].array, pos, buf);			\
+    math_bulk_load(v[2].array, pos, buf2);			\
+    for( i = 0 ; i < n ; i++ ){					\
+      buf[i] = func(buf[i], buf2[i]);				\
+    }								\
+    math_bulk_store(v[1].array, pos, n, buf);			\
+  }								\
+  v[0] = v[1];							\
+}
+
+
+MATH_BULK1( sqrt )
+MATH_BULK1( sin )
+MATH_BULK1( cos )
+MATH_BULK1( tan )
+MATH_BULK1( atan )
+MATH_BULK1( exp )
+MATH_BULK1( log )
+MATH_BULK2( atan2 )
+MATH_BULK2( hypot )
+
+
+
+// init class
+void mrbc_init_class_math(mrb_vm *vm)
+{
+  mrb_class *cls = mrbc_class_alloc(vm, "Math", mrbc_class_object);
+
+  mrbc_define_method(vm, cls, "sqrt", c_math_sqrt);
+  mrbc_define_method(vm, cls, "cbrt", c_math_cbrt);
+  mrbc_define_method(vm, cls, "sin", c_math_sin);
+  mrbc_define_method(vm, cls, "cos", c_math_cos);
+  mrbc_define_method(vm, cls, "tan", c_math_tan);
+  mrbc_define_method(vm, cls, "asin", c_math_asin);
+  mrbc_define_method(vm, cls, "acos", c_math_acos);
+  mrbc_define_method(vm, cls, "atan", c_math_atan);
+  mrbc_define_method(vm, cls, "atan2", c_math_atan2);
+  mrbc_define_method(vm, cls, "sinh", c_math_sinh);
+  mrbc_define_method(vm, cls, "cosh", c_math_cosh);
+  mrbc_define_method(vm, cls, "tanh", c_math_tanh);
+  mrbc_define_method(vm, cls, "hypot", c_math_hypot);
+  mrbc_define_method(vm, cls, "exp", c_math_exp);
+  mrbc_define_method(vm, cls, "log", c_math_log);
+  mrbc_define_method(vm, cls, "log2", c_math_log2);
+  mrbc_define_method(vm, cls, "log10", c_math_log10);
+
+  mrbc_define_method(vm, cls, "sqrt_all", c_math_sqrt_all);
+  mrbc_define_method(vm, cls, "sin_all", c_math_sin_all);
+  mrbc_define_method(vm, cls, "cos_all", c_math_cos_all);
+  mrbc_define_method(vm, cls, "tan_all", c_math_tan_all);
+  mrbc_define_method(vm, cls, "atan_all", c_math_atan_all);
+  mrbc_define_method(vm, cls, "exp_all", c_math_exp_all);
+  mrbc_define_method(vm, cls, "log_all", c_math_log_all);
+  mrbc_define_method(vm, cls, "atan2_all", c_math_atan2_all);
+  mrbc_define_method(vm, cls, "hypot_all", c_math_hypot_all);
+}
+
+#endif
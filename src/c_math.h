@@ -0,0 +1,31 @@
+/*! @file
+  @brief
+  Math module.
+
+  <pre>
+  Copyright (C) 2015 Kyushu Institute of Technology.
+  Copyright (C) 2015 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+
+  </pre>
+*/
+
+#ifndef MRBC_SRC_C_MATH_H_
+#define MRBC_SRC_C_MATH_H_
+
+#include "vm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+void mrbc_init_class_math(mrb_vm *vm);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,941 @@
+/*! @file
+  @brief
+  MessagePack serializer.
+
+  <pre>
+  Copyright (C) 2015 Kyushu Institute of Technology.
+  Copyright (C) 2015 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  Values are written in the smallest MessagePack format. Symbol is
+  written as ext type MSGPACK_EXT_SYMBOL with its name. Reader returns
+  each item with a pointer into the data, so C code can read strings
+  without copy. Arrays and Hashes are unpacked in the size written in
+  the data, without recursion.
+
+  A String of mruby/c ends at '\0' and can't hold binary data. So Ruby
+  API uses a MessagePackBuffer, which holds bytes in the capacity given
+  by the caller. An Array of Fixnum, one element per byte, is also
+  accepted and returned, but each byte takes one mrb_value (8 to 16
+  bytes) of the heap.
+  </pre>
+*/
+
+#include <stddef.h>
+#include <string.h>
+
+#include "c_msgpack.h"
+#include "alloc.h"
+#include "class.h"
+#include "static.h"
+#include "value.h"
+#include "console.h"
+#include "symbol.h"
+#include "c_hash.h"
+
+#define MSGPACK_ERR_FORMAT (-1)
+#define MSGPACK_ERR_DEPTH  (-2)
+#define MSGPACK_ERR_NOMEM  (-3)
+
+static mrb_class *mrbc_class_msgpack_buffer;
+
+
+// Internal use only
+// write data to writer
+static void msgpack_write(mrbc_msgpack_writer *w, const void *s, int len)
+{
+  if( w->error ) return;
+
+  if( w->len + len > w->size ){
+    if( !w->growable ){
+      w->error = MSGPACK_ERR_NOMEM;
+      return;
+    }
+    int size = w->size;
+    while( w->len + len > size ) size *= 2;
+    uint8_t *buf = (uint8_t *)mrbc_realloc(w->vm, w->buf, size);
+    if( buf == NULL ){  // ENOMEM
+      w->error = MSGPACK_ERR_NOMEM;
+      return;
+    }
+    w->buf = buf;
+    w->size = size;
+  }
+
+  memcpy(w->buf + w->len, s, len);
+  w->len += len;
+}
+
+
+// Internal use only
+// write format byte and big endian value of n bytes
+static void msgpack_write_head(mrbc_msgpack_writer *w, int fmt, uint64_t v, int n)
+{
+  uint8_t buf[9];
+  int i;
+
+  buf[0] = fmt;
+  for( i = n ; i > 0 ; i-- ){
+    buf[i] = v;
+    v >>= 8;
+  }
+  msgpack_write(w, buf, n + 1);
+}
+
+
+//================================================================
+/*! initialize MessagePack writer
+
+  @param  w	writer
+  @param  vm	pointer to VM.
+  @param  buf	output buffer, or NULL to allocate.
+  @param  size	size of buf.
+*/
+void mrbc_msgpack_writer_init(mrbc_msgpack_writer *w, mrb_vm *vm, uint8_t *buf, int size)
+{
+  w->vm = vm;
+  w->buf = buf;
+  w->len = 0;
+  w->size = size;
+  w->growable = 0;
+  w->error = 0;
+
+  if( buf == NULL ){
+    w->size = 32;
+    w->growable = 1;
+    w->buf = (uint8_t *)mrbc_alloc(vm, w->size);
+    if( w->buf == NULL ) w->error = MSGPACK_ERR_NOMEM;
+  }
+}
+
+
+//================================================================
+/*! write nil
+
+  @param  w	writer
+*/
+void mrbc_msgpack_write_nil(mrbc_msgpack_writer *w)
+{
+  msgpack_write(w, "\xc0", 1);
+}
+
+
+//================================================================
+/*! write true or false
+
+  @param  w	writer
+  @param  b	0 for false
+*/
+void mrbc_msgpack_write_bool(mrbc_msgpack_writer *w, int b)
+{
+  msgpack_write(w, b ? "\xc3" : "\xc2", 1);
+}
+
+
+//================================================================
+/*! write integer
+
+  @param  w	writer
+  @param  n	value
+*/
+void mrbc_msgpack_write_int(mrbc_msgpack_writer *w, int32_t n)
+{
+  if( n >= 0 ){
+    if( n < 0x80 ){
+      uint8_t c = n;			// positive fixint
+      msgpack_write(w, &c, 1);
+    } else if( n < 0x100 ){
+      msgpack_write_head(w, 0xcc, n, 1);	// uint 8
+    } else if( n < 0x10000 ){
+      msgpack_write_head(w, 0xcd, n, 2);	// uint 16
+    } else {
+      msgpack_write_head(w, 0xce, n, 4);	// uint 32
+    }
+  } else {
+    if( n >= -32 ){
+      uint8_t c = n;			// negative fixint
+      msgpack_write(w, &c, 1);
+    } else if( n >= -0x80 ){
+      msgpack_write_head(w, 0xd0, n, 1);	// int 8
+    } else if( n >= -0x8000 ){
+      msgpack_write_head(w, 0xd1, n, 2);	// int 16
+    } else {
+      msgpack_write_head(w, 0xd2, n, 4);	// int 32
+    }
+  }
+}
+
+
+#if MRBC_USE_FLOAT
+//================================================================
+/*! write float. float 32 is used, if no precision is lost.
+
+  @param  w	writer
+  @param  d	value
+*/
+void mrbc_msgpack_write_float(mrbc_msgpack_writer *w, double d)
+{
+  float f = d;
+
+  if( (double)f == d ){
+    uint32_t u;
+    memcpy(&u, &f, 4);
+    msgpack_write_head(w, 0xca, u, 4);		// float 32
+  } else {
+    uint64_t u;
+    memcpy(&u, &d, 8);
+    msgpack_write_head(w, 0xcb, u, 8);		// float 64
+  }
+}
+#endif
+
+
+//================================================================
+/*! write string
+
+  @param  w	writer
+  @param  s	string
+  @param  len	length of s
+*/
+void mrbc_msgpack_write_str(mrbc_msgpack_writer *w, const char *s, int len)
+{
+  if( len < 32 ){
+    uint8_t c = 0xa0 | len;		// fixstr
+    msgpack_write(w, &c, 1);
+  } else if( len < 0x100 ){
+    msgpack_write_head(w, 0xd9, len, 1);	// str 8
+  } else if( len < 0x10000 ){
+    msgpack_write_head(w, 0xda, len, 2);	// str 16
+  } else {
+    msgpack_write_head(w, 0xdb, len, 4);	// str 32
+  }
+  msgpack_write(w, s, len);
+}
+
+
+//================================================================
+/*! write ext
+
+  @param  w	writer
+  @param  type	ext type
+  @param  s	data
+  @param  len	length of data
+*/
+void mrbc_msgpack_write_ext(mrbc_msgpack_writer *w, int type, const char *s, int len)
+{
+  uint8_t t = type;
+
+  switch( len ){
+  case 1:  msgpack_write(w, "\xd4", 1); break;	// fixext 1
+  case 2:  msgpack_write(w, "\xd5", 1); break;	// fixext 2
+  case 4:  msgpack_write(w, "\xd6", 1); break;	// fixext 4
+  case 8:  msgpack_write(w, "\xd7", 1); break;	// fixext 8
+  case 16: msgpack_write(w, "\xd8", 1); break;	// fixext 16
+  default:
+    if( len < 0x100 ){
+      msgpack_write_head(w, 0xc7, len, 1);	// ext 8
+    } else if( len < 0x10000 ){
+      msgpack_write_head(w, 0xc8, len, 2);	// ext 16
+    } else {
+      msgpack_write_head(w, 0xc9, len, 4);	// ext 32
+    }
+  }
+  msgpack_write(w, &t, 1);
+  msgpack_write(w, s, len);
+}
+
+
+//================================================================
+/*! write array header. n elements must follow.
+
+  @param  w	writer
+  @param  n	num of elements
+*/
+void mrbc_msgpack_write_array(mrbc_msgpack_writer *w, int n)
+{
+  if( n < 16 ){
+    uint8_t c = 0x90 | n;		// fixarray
+    msgpack_write(w, &c, 1);
+  } else if( n < 0x10000 ){
+    msgpack_write_head(w, 0xdc, n, 2);	// array 16
+  } else {
+    msgpack_write_head(w, 0xdd, n, 4);	// array 32
+  }
+}
+
+
+//================================================================
+/*! write map header. n pairs of key and value must follow.
+
+  @param  w	writer
+  @param  n	num of pairs
+*/
+void mrbc_msgpack_write_map(mrbc_msgpack_writer *w, int n)
+{
+  if( n < 16 ){
+    uint8_t c = 0x80 | n;		// fixmap
+    msgpack_write(w, &c, 1);
+  } else if( n < 0x10000 ){
+    msgpack_write_head(w, 0xde, n, 2);	// map 16
+  } else {
+    msgpack_write_head(w, 0xdf, n, 4);	// map 32
+  }
+}
+
+
+// Internal use only
+// write value
+static void msgpack_pack_value(mrbc_msgpack_writer *w, mrb_value *v, int depth)
+{
+  int i, n;
+
+  if( depth > MSGPACK_MAX_DEPTH ){
+    w->error = MSGPACK_ERR_DEPTH;
+    return;
+  }
+
+  switch( v->tt ){
+  case MRB_TT_TRUE:
+    mrbc_msgpack_write_bool(w, 1);
+    break;
+
+  case MRB_TT_FALSE:
+    mrbc_msgpack_write_bool(w, 0);
+    break;
+
+  case MRB_TT_FIXNUM:
+    mrbc_msgpack_write_int(w, v->i);
+    break;
+
+#if MRBC_USE_FLOAT
+  case MRB_TT_FLOAT:
+    mrbc_msgpack_write_float(w, v->d);
+    break;
+#endif
+
+  case MRB_TT_SYMBOL: {
+    const char *s = symid_to_str(v->i);
+    if( s == NULL ){
+      w->error = MSGPACK_ERR_FORMAT;
+      break;
+    }
+    mrbc_msgpack_write_ext(w, MSGPACK_EXT_SYMBOL, s, strlen(s));
+  } break;
+
+  case MRB_TT_STRING:
+    mrbc_msgpack_write_str(w, v->str, strlen(v->str));
+    break;
+
+  case MRB_TT_ARRAY:
+    n = v->array[0].i;
+    mrbc_msgpack_write_array(w, n);
+    for( i = 1 ; i <= n ; i++ ){
+      msgpack_pack_value(w, &v->array[i], depth + 1);
+    }
+    break;
+
+  case MRB_TT_HASH: {
+    mrb_hash *h = v->hash;
+    mrbc_msgpack_write_map(w, h->count);
+    for( i = 0 ; i < h->used ; i++ ){
+      mrb_value *key = &h->entries[i*2];
+      if( key->tt == MRB_TT_EMPTY ) continue;
+      msgpack_pack_value(w, key, depth + 1);
+      msgpack_pack_value(w, key + 1, depth + 1);
+    }
+  } break;
+
+  default:
+    mrbc_msgpack_write_nil(w);
+    break;
+  }
+}
+
+
+//================================================================
+/*! write a value
+
+  @param  w	writer
+  @param  v	value
+  @return	0 if no error.
+*/
+int mrbc_msgpack_pack(mrbc_msgpack_writer *w, mrb_value *v)
+{
+  msgpack_pack_value(w, v, 0);
+  return w->error;
+}
+
+
+
+// Internal use only
+// get big endian value of n bytes
+static inline uint32_t msgpack_get(const uint8_t *p, int n)
+{
+  uint32_t v = 0;
+  while( n-- > 0 ){
+    v = (v << 8) | *p++;
+  }
+  return v;
+}
+
+
+//================================================================
+/*! initialize MessagePack reader
+
+  @param  r	reader
+  @param  buf	data
+  @param  len	length of data
+*/
+void mrbc_msgpack_reader_init(mrbc_msgpack_reader *r, const uint8_t *buf, int len)
+{
+  r->p = buf;
+  r->end = buf + len;
+}
+
+
+//================================================================
+/*! read one item
+
+  Elements of ARRAY and MAP are read as following items.
+
+  @param  r	reader
+  @param  item	read item
+  @return	0 if no error, or error code.
+*/
+int mrbc_msgpack_read(mrbc_msgpack_reader *r, mrbc_msgpack_item *item)
+{
+  const uint8_t *p = r->p;
+  int avail = r->end - p;
+  int n = 0;		// bytes of length or value field
+  int data = 0;		// item has data of len bytes
+
+  if( avail < 1 ) return MSGPACK_ERR_FORMAT;
+  int c = *p++;
+  avail--;
+  item->ext_type = 0;
+
+  if( c < 0x80 ){		// positive fixint
+    item->type = MSGPACK_INT;
+    item->i = c;
+  } else if( c >= 0xe0 ){	// negative fixint
+    item->type = MSGPACK_INT;
+    item->i = (int8_t)c;
+  } else if( c < 0x90 ){	// fixmap
+    item->type = MSGPACK_MAP;
+    item->len = c & 0x0f;
+  } else if( c < 0xa0 ){	// fixarray
+    item->type = MSGPACK_ARRAY;
+    item->len = c & 0x0f;
+  } else if( c < 0xc0 ){	// fixstr
+    item->type = MSGPACK_STR;
+    item->len = c & 0x1f;
+    data = 1;
+  } else {
+    static const uint8_t size_of[] = {	// bytes of field for 0xc0-0xdf
+      0, 0, 0, 0, 1, 2, 4, 1, 2, 4, 4, 8, 1, 2, 4, 8,
+      1, 2, 4, 8, 1, 1, 1, 1, 1, 1, 2, 4, 2, 4, 2, 4 };
+    n = size_of[c - 0xc0];
+    if( avail < n ) return MSGPACK_ERR_FORMAT;
+    uint32_t v = msgpack_get(p, n < 4 ? n : 4);
+
+    switch( c ){
+    case 0xc0: item->type = MSGPACK_NIL;	break;
+    case 0xc2: item->type = MSGPACK_FALSE;	break;
+    case 0xc3: item->type = MSGPACK_TRUE;	break;
+
+    case 0xc4: case 0xc5: case 0xc6:		// bin 8/16/32
+      item->type = MSGPACK_BIN;
+      item->len = v;
+      data = 1;
+      break;
+
+    case 0xc7: case 0xc8: case 0xc9:		// ext 8/16/32
+      item->type = MSGPACK_EXT;
+      item->len = v;
+      data = 2;
+      break;
+
+#if MRBC_USE_FLOAT
+    case 0xca: {				// float 32
+      float f;
+      memcpy(&f, &v, 4);
+      item->type = MSGPACK_FLOAT;
+      item->d = f;
+    } break;
+
+    case 0xcb: {				// float 64
+      uint64_t u = ((uint64_t)v << 32) | msgpack_get(p + 4, 4);
+      memcpy(&item->d, &u, 8);
+      item->type = MSGPACK_FLOAT;
+    } break;
+#endif
+
+    case 0xcc: case 0xcd:			// uint 8/16
+      item->type = MSGPACK_INT;
+      item->i = v;
+      break;
+
+    case 0xce:					// uint 32
+      if( v > INT32_MAX ) goto L_OUT_OF_RANGE;
+      item->type = MSGPACK_INT;
+      item->i = v;
+      break;
+
+    case 0xcf: {				// uint 64
+      uint32_t lo = msgpack_get(p + 4, 4);
+      if( v != 0 || lo > INT32_MAX ) goto L_OUT_OF_RANGE;
+      item->type = MSGPACK_INT;
+      item->i = lo;
+    } break;
+
+    case 0xd0: item->type = MSGPACK_INT; item->i = (int8_t)v;	break;
+    case 0xd1: item->type = MSGPACK_INT; item->i = (int16_t)v;	break;
+    case 0xd2: item->type = MSGPACK_INT; item->i = (int32_t)v;	break;
+
+    case 0xd3: {				// int 64
+      uint32_t lo = msgpack_get(p + 4, 4);
+      if( !((v == 0 && lo <= INT32_MAX) || (v == 0xffffffff && lo > INT32_MAX)) ){
+	goto L_OUT_OF_RANGE;
+      }
+      item->type = MSGPACK_INT;
+      item->i = (int32_t)lo;
+    } break;
+
+    case 0xd4: case 0xd5: case 0xd6: case 0xd7: case 0xd8:	// fixext
+      item->type = MSGPACK_EXT;
+      item->len = 1 << (c - 0xd4);
+      n = 0;
+      data = 2;
+      break;
+
+    case 0xd9: case 0xda: case 0xdb:		// str 8/16/32
+      item->type = MSGPACK_STR;
+      item->len = v;
+      data = 1;
+      break;
+
+    case 0xdc: case 0xdd:			// array 16/32
+      item->type = MSGPACK_ARRAY;
+      item->len = v;
+      break;
+
+    case 0xde: case 0xdf:			// map 16/32
+      item->type = MSGPACK_MAP;
+      item->len = v;
+      break;
+
+    default:					// 0xc1, never used
+      return MSGPACK_ERR_FORMAT;
+    }
+    goto L_DONE;
+
+  L_OUT_OF_RANGE:
+#if MRBC_USE_FLOAT
+    {
+      // integer out of Fixnum, as Float.
+      item->type = MSGPACK_FLOAT;
+      if( c == 0xd3 ){
+	uint32_t lo = msgpack_get(p + 4, 4);
+	item->d = (double)(int64_t)(((uint64_t)v << 32) | lo);
+      } else if( c == 0xcf ){
+	uint32_t lo = msgpack_get(p + 4, 4);
+	item->d = (double)(((uint64_t)v << 32) | lo);
+      } else {
+	item->d = v;
+      }
+    }
+#else
+    return MSGPACK_ERR_FORMAT;
+#endif
+  }
+
+ L_DONE:
+  p += n;
+  avail -= n;
+  if( data == 2 ){		// ext type
+    if( avail < 1 ) return MSGPACK_ERR_FORMAT;
+    item->ext_type = *p++;
+    avail--;
+  }
+  if( data ){
+    if( avail < item->len ) return MSGPACK_ERR_FORMAT;
+    item->str = (const char *)p;
+    p += item->len;
+  }
+
+  r->p = p;
+  return 0;
+}
+
+
+// Internal use only
+// make a value from item, except ARRAY and MAP.
+static int msgpack_item_value(mrb_vm *vm, mrbc_msgpack_item *item, mrb_value *v)
+{
+  switch( item->type ){
+  case MSGPACK_NIL:	v->tt = MRB_TT_NIL;	break;
+  case MSGPACK_FALSE:	v->tt = MRB_TT_FALSE;	break;
+  case MSGPACK_TRUE:	v->tt = MRB_TT_TRUE;	break;
+
+  case MSGPACK_INT:
+    v->tt = MRB_TT_FIXNUM;
+    v->i = item->i;
+    break;
+
+#if MRBC_USE_FLOAT
+  case MSGPACK_FLOAT:
+    v->tt = MRB_TT_FLOAT;
+    v->d = item->d;
+    break;
+#endif
+
+  case MSGPACK_STR:
+  case MSGPACK_BIN:
+  case MSGPACK_EXT: {
+    char *s = (char *)mrbc_alloc(vm, item->len + 1);
+    if( s == NULL ) return MSGPACK_ERR_NOMEM;
+    memcpy(s, item->str, item->len);
+    s[item->len] = 0;
+
+    if( item->type == MSGPACK_EXT ){
+      v->tt = MRB_TT_NIL;
+      if( item->ext_type == MSGPACK_EXT_SYMBOL ){
+	v->tt = MRB_TT_SYMBOL;
+	v->i = add_sym(s);
+      }
+      mrbc_free(vm, s);
+    } else {
+      mrbc_set_tt(s, MRB_TT_STRING);
+      v->tt = MRB_TT_STRING;
+      v->str = s;
+    }
+  } break;
+
+  default:
+    return MSGPACK_ERR_FORMAT;
+  }
+
+  return 0;
+}
+
+
+// Internal use only
+// Array or Hash in unpacking
+struct MSGPACK_FRAME {
+  mrb_value obj;	// Array or Hash
+  mrb_value key;	// key of Hash, waiting for the value
+  uint32_t  n;		// num of elements or pairs
+  uint32_t  i;		// num of read elements or pairs
+  uint8_t   has_key;
+};
+
+
+//================================================================
+/*! read a value
+
+  @param  vm	pointer to VM.
+  @param  r	reader
+  @return	value. MRB_TT_EMPTY if error.
+*/
+mrb_value mrbc_msgpack_unpack(mrb_vm *vm, mrbc_msgpack_reader *r)
+{
+  struct MSGPACK_FRAME stack[MSGPACK_MAX_DEPTH];
+  int depth = 0;
+  mrbc_msgpack_item item;
+  mrb_value v;
+
+  while( 1 ){
+    v.tt = MRB_TT_EMPTY;
+    if( mrbc_msgpack_read(r, &item) != 0 ) goto L_ERROR;
+
+    if( item.type == MSGPACK_ARRAY || item.type == MSGPACK_MAP ){
+      if( item.len > (r->end - r->p) ) goto L_ERROR;	// too large
+      if( item.type == MSGPACK_ARRAY ){
+	v.tt = MRB_TT_ARRAY;
+	v.array = (mrb_value *)mrbc_alloc(vm, sizeof(mrb_value) * (item.len + 1));
+	if( v.array == NULL ) goto L_ERROR;
+	mrbc_set_tt(v.array, MRB_TT_ARRAY);
+	v.array[0].tt = MRB_TT_FIXNUM;
+	v.array[0].i = item.len;
+      } else {
+	v = mrbc_hash_new(vm, item.len);
+	if( v.hash == NULL ) goto L_ERROR;
+      }
+
+      if( item.len > 0 ){
+	if( depth >= MSGPACK_MAX_DEPTH ) goto L_ERROR;
+	stack[depth].obj = v;
+	stack[depth].n = item.len;
+	stack[depth].i = 0;
+	stack[depth].has_key = 0;
+	depth++;
+	continue;
+      }
+
+    } else if( msgpack_item_value(vm, &item, &v) != 0 ){
+      goto L_ERROR;
+    }
+
+    // store the value to the container, and close filled ones.
+    while( depth > 0 ){
+      struct MSGPACK_FRAME *f = &stack[depth-1];
+      if( f->obj.tt == MRB_TT_ARRAY ){
+	f->obj.array[++f->i] = v;
+      } else if( !f->has_key ){
+	f->key = v;
+	f->has_key = 1;
+	break;
+      } else {
+	mrb_value *old = mrbc_hash_get(&f->obj, &f->key);
+	if( old ){		// duplicated key. the last one wins.
+	  mrbc_release(vm, old);
+	  mrbc_release(vm, &f->key);
+	  *old = v;
+	} else if( mrbc_hash_set(vm, &f->obj, &f->key, &v) != 0 ){
+	  goto L_ERROR;
+	}
+	f->has_key = 0;
+	f->i++;
+      }
+      v.tt = MRB_TT_EMPTY;	// now owned by the container.
+      if( f->i < f->n ) break;
+
+      v = f->obj;
+      depth--;
+    }
+    if( depth == 0 ) return v;
+  }
+
+ L_ERROR:
+  // release the value not yet stored, and the open containers.
+  mrbc_release(vm, &v);
+  while( depth > 0 ){
+    struct MSGPACK_FRAME *f = &stack[--depth];
+    if( f->obj.tt == MRB_TT_ARRAY ){
+      f->obj.array[0].i = f->i;		// only filled elements.
+    } else if( f->has_key ){
+      mrbc_release(vm, &f->key);
+    }
+    mrbc_release(vm, &f->obj);
+  }
+
+  v.tt = MRB_TT_EMPTY;
+  return v;
+}
+
+
+
+// Internal use only
+// get MessagePackBuffer, or NULL.
+static mrbc_msgpack_buffer *msgpack_buffer(mrb_value *v)
+{
+  if( v->tt != MRB_TT_OBJECT || v->obj->cls != mrbc_class_msgpack_buffer ){
+    return NULL;
+  }
+  return (mrbc_msgpack_buffer *)v->obj;
+}
+
+
+// method
+// MessagePack.pack
+//  pack(obj) returns Array of bytes.
+//  pack(obj, buf) writes into MessagePackBuffer buf, and returns buf.
+static void c_msgpack_pack(mrb_vm *vm, mrb_value *v)
+{
+  mrbc_msgpack_writer w;
+  int i;
+
+  if( mrbc_get_argc(vm) >= 2 ){
+    mrbc_msgpack_buffer *buf = msgpack_buffer(&v[2]);
+    if( buf == NULL ){
+      console_printf("TypeError: MessagePack.pack needs MessagePackBuffer\n");
+      SET_NIL_RETURN();
+      return;
+    }
+    mrbc_msgpack_writer_init(&w, vm, buf->data, buf->size);
+    if( mrbc_msgpack_pack(&w, v + 1) != 0 ){
+      console_printf("MessagePack: can't pack into buffer\n");
+      SET_NIL_RETURN();
+      return;
+    }
+    buf->len = w.len;
+    v[0] = v[2];
+    return;
+  }
+
+  mrbc_msgpack_writer_init(&w, vm, NULL, 0);
+  if( mrbc_msgpack_pack(&w, v + 1) != 0 ){
+    console_printf("MessagePack: can't pack\n");
+    goto L_RETURN;
+  }
+
+  mrb_value *array = (mrb_value *)mrbc_alloc(vm, sizeof(mrb_value) * (w.len + 1));
+  if( array == NULL ) goto L_RETURN;  // ENOMEM
+  mrbc_set_tt(array, MRB_TT_ARRAY);
+  array[0].tt = MRB_TT_FIXNUM;
+  array[0].i = w.len;
+  for( i = 0 ; i < w.len ; i++ ){
+    array[i+1].tt = MRB_TT_FIXNUM;
+    array[i+1].i = w.buf[i];
+  }
+  mrbc_free(vm, w.buf);
+  v->tt = MRB_TT_ARRAY;
+  v->array = array;
+  return;
+
+ L_RETURN:
+  if( w.buf ) mrbc_free(vm, w.buf);
+  SET_NIL_RETURN();
+}
+
+
+// method
+// MessagePack.unpack
+//  unpack(MessagePackBuffer) or unpack(Array of bytes)
+static void c_msgpack_unpack(mrb_vm *vm, mrb_value *v)
+{
+  mrbc_msgpack_reader r;
+  mrbc_msgpack_buffer *mb = msgpack_buffer(&v[1]);
+  mrb_value ret;
+  uint8_t *buf = NULL;
+  int i, len;
+
+  if( mb != NULL ){
+    mrbc_msgpack_reader_init(&r, mb->data, mb->len);
+
+  } else if( v[1].tt == MRB_TT_ARRAY ){
+    len = v[1].array[0].i;
+    buf = (uint8_t *)mrbc_alloc(vm, len ? len : 1);
+    if( buf == NULL ) goto L_ERROR;  // ENOMEM
+    for( i = 0 ; i < len ; i++ ){
+      buf[i] = v[1].array[i+1].i;
+    }
+    mrbc_msgpack_reader_init(&r, buf, len);
+
+  } else {
+    console_printf("TypeError: MessagePack.unpack needs MessagePackBuffer or Array\n");
+    goto L_ERROR;
+  }
+
+  ret = mrbc_msgpack_unpack(vm, &r);
+  if( buf ) mrbc_free(vm, buf);
+  if( ret.tt == MRB_TT_EMPTY ){
+    console_printf("MessagePack: malformed data\n");
+    goto L_ERROR;
+  }
+  v[0] = ret;
+  return;
+
+ L_ERROR:
+  SET_NIL_RETURN();
+}
+
+
+// method
+// MessagePackBuffer.new(capacity)
+static void c_msgpack_buffer_new(mrb_vm *vm, mrb_value *v)
+{
+  if( v[1].tt != MRB_TT_FIXNUM || v[1].i <= 0 ){
+    console_printf("ArgumentError: MessagePackBuffer.new needs capacity\n");
+    SET_NIL_RETURN();
+    return;
+  }
+
+  mrbc_msgpack_buffer *buf = (mrbc_msgpack_buffer *)
+    mrbc_alloc(vm, sizeof(mrbc_msgpack_buffer) + v[1].i);
+  if( buf == NULL ){  // ENOMEM
+    SET_NIL_RETURN();
+    return;
+  }
+  mrbc_set_tt(buf, MRB_TT_OBJECT);
+  buf->obj.tt  = MRB_TT_OBJECT;
+  buf->obj.cls = mrbc_class_msgpack_buffer;
+  buf->len  = 0;
+  buf->size = v[1].i;
+
+  v[0].tt  = MRB_TT_OBJECT;
+  v[0].obj = &buf->obj;
+}
+
+
+// method
+// MessagePackBuffer#size
+//  length of data.
+static void c_msgpack_buffer_size(mrb_vm *vm, mrb_value *v)
+{
+  mrbc_msgpack_buffer *buf = msgpack_buffer(&v[0]);
+  if( buf == NULL ) return;
+
+  SET_INT_RETURN(buf->len);
+}
+
+
+// method
+// MessagePackBuffer#[]
+//  byte at the index, or nil.
+static void c_msgpack_buffer_get(mrb_vm *vm, mrb_value *v)
+{
+  mrbc_msgpack_buffer *buf = msgpack_buffer(&v[0]);
+  if( buf == NULL ) return;
+
+  int i = (v[1].tt == MRB_TT_FIXNUM) ? v[1].i : -1;
+  if( i < 0 ) i += buf->len;
+  if( i < 0 || i >= buf->len ){
+    SET_NIL_RETURN();
+    return;
+  }
+  SET_INT_RETURN(buf->data[i]);
+}
+
+
+// method
+// MessagePackBuffer#<<
+//  append a byte. returns self, or nil if the buffer is full.
+static void c_msgpack_buffer_push(mrb_vm *vm, mrb_value *v)
+{
+  mrbc_msgpack_buffer *buf = msgpack_buffer(&v[0]);
+  if( buf == NULL ) return;
+
+  if( v[1].tt != MRB_TT_FIXNUM ){
+    console_printf("TypeError: MessagePackBuffer#<< needs Fixnum\n");
+    SET_NIL_RETURN();
+    return;
+  }
+  if( buf->len >= buf->size ){
+    console_printf("IndexError: MessagePackBuffer is full\n");
+    SET_NIL_RETURN();
+    return;
+  }
+  buf->data[buf->len++] = v[1].i;
+}
+
+
+// method
+// MessagePackBuffer#clear
+static void c_msgpack_buffer_clear(mrb_vm *vm, mrb_value *v)
+{
+  mrbc_msgpack_buffer *buf = msgpack_buffer(&v[0]);
+  if( buf == NULL ) return;
+
+  buf->len = 0;
+}
+
+
+
+// init class
+void mrbc_init_class_msgpack(mrb_vm *vm)
+{
+  mrb_class *cls = mrbc_class_alloc(vm, "MessagePack", mrbc_class_object);
+
+  mrbc_define_method(vm, cls, "pack", c_msgpack_pack);
+  mrbc_define_method(vm, cls, "unpack", c_msgpack_unpack);
+
+  cls = mrbc_class_alloc(vm, "MessagePackBuffer", mrbc_class_object);
+  mrbc_class_msgpack_buffer = cls;
+  mrbc_define_method(vm, cls, "new", c_msgpack_buffer_new);
+  mrbc_define_method(vm, cls, "size", c_msgpack_buffer_size);
+  mrbc_define_method(vm, cls, "[]", c_msgpack_buffer_get);
+  mrbc_define_method(vm, cls, "<<", c_msgpack_buffer_push);
+  mrbc_define_method(vm, cls, "clear", c_msgpack_buffer_clear);
+}
@@ -0,0 +1,138 @@
+/*! @file
+  @brief
+  MessagePack serializer.
+
+  <pre>
+  Copyright (C) 2015 Kyushu Institute of Technology.
+  Copyright (C) 2015 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+
+  </pre>
+*/
+
+#ifndef MRBC_SRC_C_MSGPACK_H_
+#define MRBC_SRC_C_MSGPACK_H_
+
+#include <stdint.h>
+#include "vm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* maximum nesting of arrays and maps */
+#ifndef MSGPACK_MAX_DEPTH
+#define MSGPACK_MAX_DEPTH 32
+#endif
+
+/* ext type for Symbol. same as msgpack-ruby's convention. */
+#define MSGPACK_EXT_SYMBOL 0
+
+
+//================================================================
+/*!@brief
+  MessagePack writer
+
+  If buf is given by the caller, output is limited to its size.
+  Otherwise a buffer is allocated, and grows as needed.
+*/
+typedef struct RMsgpackWriter {
+  mrb_vm  *vm;
+  uint8_t *buf;		//!< output buffer
+  int      len;		//!< length of output
+  int      size;	//!< buffer size
+  uint8_t  growable;	//!< buf is allocated by writer
+  int      error;	//!< 0 if no error
+} mrbc_msgpack_writer;
+
+
+//================================================================
+/*!@brief
+  type of item
+*/
+enum MSGPACK_TYPE {
+  MSGPACK_NIL,
+  MSGPACK_FALSE,
+  MSGPACK_TRUE,
+  MSGPACK_INT,
+  MSGPACK_FLOAT,
+  MSGPACK_STR,
+  MSGPACK_BIN,
+  MSGPACK_ARRAY,
+  MSGPACK_MAP,
+  MSGPACK_EXT,
+};
+
+
+//================================================================
+/*!@brief
+  one item read from MessagePack data
+
+  str points into the data, without copy. It is not terminated by '\0'.
+*/
+typedef struct RMsgpackItem {
+  uint8_t  type;	//!< enum MSGPACK_TYPE
+  int8_t   ext_type;	//!< type of EXT
+  uint32_t len;		//!< bytes of STR, BIN and EXT, or num of elements
+			//!< of ARRAY, or num of pairs of MAP
+  int32_t  i;		//!< value of INT
+#if MRBC_USE_FLOAT
+  double   d;		//!< value of FLOAT
+#endif
+  const char *str;	//!< data of STR, BIN and EXT
+} mrbc_msgpack_item;
+
+
+//================================================================
+/*!@brief
+  MessagePack reader
+*/
+typedef struct RMsgpackReader {
+  const uint8_t *p;	//!< read point
+  const uint8_t *end;	//!< end of data
+} mrbc_msgpack_reader;
+
+
+//================================================================
+/*!@brief
+  byte buffer for Ruby, an instance of MessagePackBuffer
+
+  Data is held in bytes, with the capacity given to
+  MessagePackBuffer.new. MessagePack.pack writes into it, and
+  MessagePack.unpack reads from it, without a copy.
+*/
+typedef struct RMsgpackBuffer {
+  mrb_object obj;
+  int      len;		//!< length of data
+  int      size;	//!< capacity
+  uint8_t  data[];
+} mrbc_msgpack_buffer;
+
+
+void mrbc_msgpack_writer_init(mrbc_msgpack_writer *w, mrb_vm *vm, uint8_t *buf, int size);
+void mrbc_msgpack_write_nil(mrbc_msgpack_writer *w);
+void mrbc_msgpack_write_bool(mrbc_msgpack_writer *w, int b);
+void mrbc_msgpack_write_int(mrbc_msgpack_writer *w, int32_t n);
+#if MRBC_USE_FLOAT
+void mrbc_msgpack_write_float(mrbc_msgpack_writer *w, double d);
+#endif
+void mrbc_msgpack_write_str(mrbc_msgpack_writer *w, const char *s, int len);
+void mrbc_msgpack_write_ext(mrbc_msgpack_writer *w, int type, const char *s, int len);
+void mrbc_msgpack_write_array(mrbc_msgpack_writer *w, int n);
+void mrbc_msgpack_write_map(mrbc_msgpack_writer *w, int n);
+int mrbc_msgpack_pack(mrbc_msgpack_writer *w, mrb_value *v);
+
+void mrbc_msgpack_reader_init(mrbc_msgpack_reader *r, const uint8_t *buf, int len);
+int mrbc_msgpack_read(mrbc_msgpack_reader *r, mrbc_msgpack_item *item);
+mrb_value mrbc_msgpack_unpack(mrb_vm *vm, mrbc_msgpack_reader *r);
+
+void mrbc_init_class_msgpack(mrb_vm *vm);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
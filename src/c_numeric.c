@@ -99,6 +99,7 @@ static void c_fixnum_to_s(mrb_vm *vm, mrb_value *v)
   }
   char *str = (char *)mrbc_alloc(vm, i+2);
   if( str == NULL ) return;  // ENOMEM
+  mrbc_set_tt(str, MRB_TT_STRING);
   while( i>=0 ){
     str[j++] = buf[i--];
   }
@@ -1,6 +1,7 @@
 #include <stddef.h>
 
 #include "c_range.h"
+#include "c_enum.h"
 
 #include "alloc.h"
 #include "class.h"
@@ -16,6 +17,7 @@ mrb_value mrbc_range_new(mrb_vm *vm, mrb_value *v_st, mrb_value *v_ed, int exclu
 
   mrb_value *ptr = (mrb_value*)mrbc_alloc(vm, sizeof(mrb_value)*3);
   if( ptr == NULL ) return value;  // ENOMEM
+  mrbc_set_tt(ptr, MRB_TT_RANGE);
 
   if( exclude ){
     ptr[0].tt = MRB_TT_TRUE;
@@ -37,5 +39,6 @@ void mrbc_init_class_range(mrb_vm *vm)
 {
   mrbc_class_range = mrbc_class_alloc(vm, "Range", mrbc_class_object);
 
+  mrbc_define_enum_methods(vm, mrbc_class_range);
 
 }
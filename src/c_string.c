@@ -1,3 +1,4 @@
+#include <stdlib.h>
 #include <string.h>
 #include "c_string.h"
 
@@ -6,6 +7,8 @@
 #include "static.h"
 #include "value.h"
 #include "vm.h"
+#include "console.h"
+#include "symbol.h"
 
 // dupulicate string (clone)
 // returns duplicated string pointer
@@ -14,6 +17,7 @@ char* mrbc_string_dup(mrb_vm *vm, const char *str)
   int len = strlen((char *)str);
   char *ptr = (char *)mrbc_alloc(vm, len+1);
   if( ptr == NULL ) return NULL;  // ENOMEM
+  mrbc_set_tt(ptr, MRB_TT_STRING);
 
   strcpy(ptr, str);
   return ptr;
@@ -27,23 +31,190 @@ char *mrbc_string_cat(mrb_vm *vm, char *s1, const char *s2)
   int len2 = strlen(s2);
   char *ptr = (char *)mrbc_alloc(vm, len1+len2+1);
   if( ptr == NULL ) return NULL;  // ENOMEM
+  mrbc_set_tt(ptr, MRB_TT_STRING);
 
   strcpy(ptr, s1);
   strcpy(ptr+len1, s2);
   return ptr;
 }
 
+// format a value as to_s
+static void format_value_to_s(mrbc_format_out *out, mrb_value *v, mrbc_format_spec *spec)
+{
+  switch( v->tt ){
+  case MRB_TT_STRING:
+    mrbc_format_str(out, v->str, spec);
+    break;
+  case MRB_TT_FIXNUM:
+    mrbc_format_int(out, v->i, 10, spec);
+    break;
+#if MRBC_USE_FLOAT
+  case MRB_TT_FLOAT: {
+    // same as Float#to_s, 1.0 is "1.0" not "1".
+    mrbc_format_spec gspec = { 'g', ' ', 1, 0, -1 };
+    mrbc_format_out gout;
+    char buf[32];
+    mrbc_format_init(&gout, buf, sizeof(buf) - 2);
+    mrbc_format_float(&gout, v->d, &gspec);
+    buf[gout.len] = 0;
+    if( !strpbrk(buf, ".e") && !strstr(buf, "inf") && !strstr(buf, "nan") ){
+      strcpy(buf + gout.len, ".0");
+    }
+    mrbc_format_str(out, buf, spec);
+  } break;
+#endif
+  case MRB_TT_SYMBOL:
+    mrbc_format_str(out, symid_to_str(v->i), spec);
+    break;
+  case MRB_TT_TRUE:
+    mrbc_format_str(out, "true", spec);
+    break;
+  case MRB_TT_FALSE:
+    mrbc_format_str(out, "false", spec);
+    break;
+  default:
+    mrbc_format_str(out, "", spec);
+    break;
+  }
+}
+
+
+// format arguments to output
+// returns 0 if success, or -1 if too few arguments
+static int format_values(mrbc_format_out *out, const char *fmt, mrb_value *v, int argc)
+{
+  mrbc_format_spec spec;
+  int i = 0;
+
+  while( (fmt = mrbc_format_parse(out, fmt, &spec)) != NULL ){
+    if( i >= argc ) return -1;
+    mrb_value *arg = &v[i++];
+
+    switch( spec.type ){
+    case 'd':
+    case 'i':
+    case 'u':
+#if MRBC_USE_FLOAT
+      if( arg->tt == MRB_TT_FLOAT ){
+	mrbc_format_int(out, (int32_t)arg->d, 10, &spec);
+	break;
+      }
+#endif
+      mrbc_format_int(out, arg->tt == MRB_TT_FIXNUM ? arg->i : 0, 10, &spec);
+      break;
+
+    case 'b':
+    case 'o':
+    case 'x':
+    case 'X':
+      mrbc_format_uint(out, arg->tt == MRB_TT_FIXNUM ? arg->i : 0,
+		       spec.type == 'b' ? 2 : spec.type == 'o' ? 8 : 16, &spec);
+      break;
+
+#if MRBC_USE_FLOAT
+    case 'f':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+      mrbc_format_float(out, arg->tt == MRB_TT_FLOAT ? arg->d :
+			arg->tt == MRB_TT_FIXNUM ? arg->i : 0, &spec);
+      break;
+#endif
+
+    case 'c':{
+      char buf[2] = {0, 0};
+      if( arg->tt == MRB_TT_FIXNUM ) buf[0] = arg->i;
+      if( arg->tt == MRB_TT_STRING ) buf[0] = arg->str[0];
+      mrbc_format_str(out, buf, &spec);
+    } break;
+
+    case 's':
+      format_value_to_s(out, arg, &spec);
+      break;
+
+    default:
+      i--;
+      mrbc_format_str(out, "%", &spec);
+      break;
+    }
+  }
+
+  return 0;
+}
+
+
+//================================================================
+/*! format values into a new string
+
+  The length is counted first, so the result is allocated once.
+
+  @param  vm	pointer to VM.
+  @param  fmt	format string.
+  @param  v	arguments.
+  @param  argc	num of arguments.
+  @return	new string, or NULL if error.
+*/
+char *mrbc_string_format(mrb_vm *vm, const char *fmt, mrb_value *v, int argc)
+{
+  mrbc_format_out out;
+
+  mrbc_format_init(&out, NULL, 0);
+  if( format_values(&out, fmt, v, argc) < 0 ){
+    console_printf("ArgumentError: too few arguments\n");
+    return NULL;
+  }
+
+  int len = out.len;
+  char *ptr = (char *)mrbc_alloc(vm, len+1);
+  if( ptr == NULL ) return NULL;  // ENOMEM
+  mrbc_set_tt(ptr, MRB_TT_STRING);
+
+  mrbc_format_init(&out, ptr, len);
+  format_values(&out, fmt, v, argc);
+  ptr[len] = 0;
+  return ptr;
+}
+
+
+//================================================================
+/*! append the value as to_s, in place
+
+  @param  vm	pointer to VM.
+  @param  s1	string, will be reallocated.
+  @param  v	value to append.
+  @return	new pointer of the string, or NULL if error.
+*/
+char *mrbc_string_append(mrb_vm *vm, char *s1, mrb_value *v)
+{
+  mrbc_format_out out;
+  mrbc_format_spec spec = { 's', ' ', 1, 0, -1 };
+
+  mrbc_format_init(&out, NULL, 0);
+  format_value_to_s(&out, v, &spec);
+  int len1 = strlen(s1);
+  int len2 = out.len;
+
+  char *ptr = (char *)mrbc_realloc(vm, s1, len1+len2+1);
+  if( ptr == NULL ) return NULL;  // ENOMEM
+
+  mrbc_format_init(&out, ptr + len1, len2);
+  spec.type = 's';
+  format_value_to_s(&out, v, &spec);
+  ptr[len1+len2] = 0;
+  return ptr;
+}
+
+
 // substr
 // returns new string
 static char *mrbc_string_substr(mrb_vm *vm, char *s, int start, int len)
 {
   char *ptr = (char *)mrbc_alloc(vm, len+1);
   if( ptr == NULL ) return NULL;  // ENOMEM
+  mrbc_set_tt(ptr, MRB_TT_STRING);
 
-  int i;
-  for( i=0 ; i<len ; i++ ){
-    ptr[i] = s[start+i];
-  }
+  memcpy(ptr, s+start, len);
   ptr[len] = 0;
   return ptr;
 }
@@ -80,21 +251,521 @@ static void c_string_idx_get(mrb_vm *vm, mrb_value *v)
 }
 
 
+// search pat in s, using memchr for the first byte.
+// returns pointer to found position, or NULL
+static const char *mrbc_string_search(const char *s, int len, const char *pat, int plen)
+{
+  if( plen == 0 ) return s;
+  if( plen > len ) return NULL;
+
+  const char *end = s + len - plen + 1;	// last position + 1
+  while( s < end ){
+    s = memchr(s, pat[0], end - s);
+    if( s == NULL ) return NULL;
+    if( memcmp(s+1, pat+1, plen-1) == 0 ) return s;
+    s++;
+  }
+  return NULL;
+}
+
+
+// check argument is a string
+static int is_string_arg(mrb_value *v, int n)
+{
+  if( v[n].tt == MRB_TT_STRING ) return 1;
+
+  console_printf("TypeError: no implicit conversion into String\n");
+  SET_NIL_RETURN();
+  return 0;
+}
+
+
+// whitespace?
+static inline int is_space(int ch)
+{
+  return ch == ' ' || (ch >= '\t' && ch <= '\r');
+}
+
+
+// digit value of the character, or 99 if not a digit
+static inline int digit_value(int ch)
+{
+  if( ch >= '0' && ch <= '9' ) return ch - '0';
+  if( ch >= 'a' && ch <= 'z' ) return ch - 'a' + 10;
+  if( ch >= 'A' && ch <= 'Z' ) return ch - 'A' + 10;
+  return 99;
+}
+
+
+//================================================================
+/*! convert string to integer
+
+  Leading whitespace, sign, radix prefix (0x 0b 0o 0d) and underscores
+  between digits are accepted.
+
+  @param  s		string
+  @param  base		radix 2..36, or 0 to detect by prefix.
+  @param  strict	if 1, garbage or no digits makes an error. (for Integer())
+  @param  value		result. saturated if overflow.
+  @return		0 if success, -1 if invalid, -2 if overflow.
+*/
+int mrbc_string_to_i(const char *s, int base, int strict, int32_t *value)
+{
+  const char *p = s;
+  int sign = 0;
+  int ret = 0;
+  int ndigits = 0;
+  uint32_t n = 0;
+
+  *value = 0;
+  while( is_space(*p) ) p++;
+  if( *p == '+' || *p == '-' ) sign = (*p++ == '-');
+
+  // radix prefix
+  if( p[0] == '0' ){
+    int b = 0;
+    switch( p[1] ){
+    case 'x': case 'X': b = 16; break;
+    case 'b': case 'B': b = 2;  break;
+    case 'o': case 'O': b = 8;  break;
+    case 'd': case 'D': b = 10; break;
+    }
+    if( b && (base == 0 || base == b) ){
+      base = b;
+      p += 2;
+    } else if( base == 0 && p[1] ){
+      base = 8;		// "010"
+    }
+  }
+  if( base == 0 ) base = 10;
+  if( base < 2 || base > 36 ) return -1;
+
+  uint32_t limit = sign ? 0x80000000u : 0x7fffffffu;
+  while( 1 ){
+    if( *p == '_' && ndigits && p[1] != '_' && p[1] != 0 ){
+      p++;
+      continue;
+    }
+    int d = digit_value(*p);
+    if( d >= base ) break;
+
+    if( ret == 0 && n > (limit - d) / base ){
+      ret = -2;
+      n = limit;
+    } else if( ret == 0 ){
+      n = n * base + d;
+    }
+    ndigits++;
+    p++;
+  }
+
+  if( strict ){
+    while( is_space(*p) ) p++;
+    if( *p || ndigits == 0 ) return -1;
+  }
+
+  *value = sign ? (int32_t)(0u - n) : (int32_t)n;
+  return ret;
+}
+
+
+#if MRBC_USE_FLOAT
+//================================================================
+/*! convert string to double
+
+  Fast path (Clinger): when the mantissa fits in 53 bits and the
+  power of ten is exact in double, one multiply or divide gives the
+  correctly rounded result. Otherwise falls back to strtod().
+
+  @param  s		string
+  @return		result, or 0.0 if not a number.
+*/
+double mrbc_string_to_f(const char *s)
+{
+  static const double pow10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+  const char *p = s;
+  int sign = 0;
+  uint64_t mant = 0;
+  int ndigits = 0;	// significant digits in mant
+  int truncated = 0;
+  int exp10 = 0;
+  char buf[48];		// cleaned string for strtod()
+  int len = 0;
+
+  while( is_space(*p) ) p++;
+  if( *p == '+' || *p == '-' ) sign = (*p++ == '-');
+
+  // mantissa
+  int in_frac = 0;
+  int seen = 0;
+  while( 1 ){
+    if( *p >= '0' && *p <= '9' ){
+      int d = *p - '0';
+      if( ndigits < 19 ){
+	mant = mant * 10 + d;
+	if( mant ) ndigits++;
+	if( in_frac ) exp10--;
+      } else {
+	if( d ) truncated = 1;
+	if( !in_frac ) exp10++;
+      }
+      seen = 1;
+      if( len < sizeof(buf) - 8 ) buf[len++] = *p;
+    } else if( *p == '_' && seen && p[1] >= '0' && p[1] <= '9' ){
+      // skip
+    } else if( *p == '.' && !in_frac && seen && p[1] >= '0' && p[1] <= '9' ){
+      in_frac = 1;
+      if( len < sizeof(buf) - 8 ) buf[len++] = '.';
+    } else {
+      break;
+    }
+    p++;
+  }
+  if( !seen ) return 0.0;
+
+  // exponent
+  if( (*p == 'e' || *p == 'E') ){
+    const char *q = p + 1;
+    int esign = 0;
+    int e = 0;
+    if( *q == '+' || *q == '-' ) esign = (*q++ == '-');
+    if( *q >= '0' && *q <= '9' ){
+      while( *q >= '0' && *q <= '9' ){
+	if( e < 10000 ) e = e * 10 + (*q - '0');
+	q++;
+      }
+      exp10 += esign ? -e : e;
+
+      // e is 5 digits at most, so "e-99999" fits in the rest of buf.
+      char digit[5];
+      int n = 0;
+      buf[len++] = 'e';
+      if( esign ) buf[len++] = '-';
+      do {
+	digit[n++] = '0' + e % 10;
+	e /= 10;
+      } while( e );
+      while( n > 0 ) buf[len++] = digit[--n];
+    }
+  }
+
+  double d;
+  if( mant == 0 ){
+    d = 0.0;
+
+  } else if( !truncated && mant <= (1ULL << 53) && exp10 >= -22 && exp10 <= 22 ){
+    d = (double)mant;
+    if( exp10 < 0 ){
+      d /= pow10[-exp10];
+    } else {
+      d *= pow10[exp10];
+    }
+
+  } else if( len < sizeof(buf) - 8 ){
+    buf[len] = 0;
+    d = strtod(buf, NULL);
+    return sign ? -d : d;
+
+  } else {
+    d = strtod(s, NULL);	// too long, leave it to libc.
+    return d;
+  }
+
+  return sign ? -d : d;
+}
+#endif
+
+
 // method
 // string to_i
-static void c_string_to_fixnum(mrb_vm *vm, mrb_value *v)
+//  to_i
+//  to_i(base)
+static void c_string_to_i(mrb_vm *vm, mrb_value *v)
 {
-  char *str = v->str;
-  int value = 0;
-  while( *str && *str >= '0' && *str <= '9' ){
-    value *= 10;
-    value += *str - '0';
-    str++;
+  int base = 10;
+  int32_t value;
+
+  if( v[1].tt == MRB_TT_FIXNUM ){
+    base = v[1].i;
+    if( base < 2 || base > 36 ){
+      console_printf("ArgumentError: invalid radix %d\n", base);
+      SET_NIL_RETURN();
+      return;
+    }
   }
+
+  mrbc_string_to_i(v->str, base, 0, &value);
   SET_INT_RETURN(value);
 }
 
 
+#if MRBC_USE_FLOAT
+// method
+// string to_f
+static void c_string_to_f(mrb_vm *vm, mrb_value *v)
+{
+  double d = mrbc_string_to_f(v->str);
+  SET_FLOAT_RETURN(d);
+}
+#endif
+
+
+// method
+// string ==
+static void c_string_eq(mrb_vm *vm, mrb_value *v)
+{
+  if( mrbc_eq(v, v+1) ){
+    SET_TRUE_RETURN();
+  } else {
+    SET_FALSE_RETURN();
+  }
+}
+
+
+// method
+// string index
+//  index(substr)
+//  index(substr, pos)
+static void c_string_index(mrb_vm *vm, mrb_value *v)
+{
+  if( !is_string_arg(v, 1) ) return;
+
+  int len = strlen(v->str);
+  int pos = 0;
+  if( v[2].tt == MRB_TT_FIXNUM ){
+    pos = v[2].i;
+    if( pos < 0 ) pos += len;
+    if( pos < 0 || pos > len ){
+      SET_NIL_RETURN();
+      return;
+    }
+  }
+
+  const char *p = mrbc_string_search(v->str + pos, len - pos,
+				     v[1].str, strlen(v[1].str));
+  if( p ){
+    SET_INT_RETURN( p - v->str );
+  } else {
+    SET_NIL_RETURN();
+  }
+}
+
+
+// method
+// string include?
+static void c_string_include(mrb_vm *vm, mrb_value *v)
+{
+  if( !is_string_arg(v, 1) ) return;
+
+  if( mrbc_string_search(v->str, strlen(v->str),
+			 v[1].str, strlen(v[1].str)) ){
+    SET_TRUE_RETURN();
+  } else {
+    SET_FALSE_RETURN();
+  }
+}
+
+
+// method
+// string start_with?
+static void c_string_start_with(mrb_vm *vm, mrb_value *v)
+{
+  if( !is_string_arg(v, 1) ) return;
+
+  if( strncmp(v->str, v[1].str, strlen(v[1].str)) == 0 ){
+    SET_TRUE_RETURN();
+  } else {
+    SET_FALSE_RETURN();
+  }
+}
+
+
+// method
+// string end_with?
+static void c_string_end_with(mrb_vm *vm, mrb_value *v)
+{
+  if( !is_string_arg(v, 1) ) return;
+
+  int len = strlen(v->str);
+  int len2 = strlen(v[1].str);
+  if( len2 <= len && memcmp(v->str + len - len2, v[1].str, len2) == 0 ){
+    SET_TRUE_RETURN();
+  } else {
+    SET_FALSE_RETURN();
+  }
+}
+
+
+// method
+// string count
+//  count("chars")  count of any characters in "chars"
+static void c_string_count(mrb_vm *vm, mrb_value *v)
+{
+  if( !is_string_arg(v, 1) ) return;
+
+  const char *s = v->str;
+  const char *chars = v[1].str;
+  int cnt = 0;
+
+  if( chars[0] == 0 ){
+    SET_INT_RETURN(0);
+    return;
+  }
+
+  // one character, by memchr.
+  if( chars[1] == 0 ){
+    const char *end = s + strlen(s);
+    while( (s = memchr(s, chars[0], end - s)) != NULL ){
+      cnt++;
+      s++;
+    }
+    SET_INT_RETURN(cnt);
+    return;
+  }
+
+  // character set.
+  uint8_t set[256/8];
+  memset(set, 0, sizeof(set));
+  for( ; *chars ; chars++ ){
+    uint8_t ch = *chars;
+    set[ch >> 3] |= 1 << (ch & 7);
+  }
+  for( ; *s ; s++ ){
+    uint8_t ch = *s;
+    if( set[ch >> 3] & (1 << (ch & 7)) ) cnt++;
+  }
+  SET_INT_RETURN(cnt);
+}
+
+
+// method
+// string split
+//  split         split by whitespace
+//  split(sep)
+static void c_string_split(mrb_vm *vm, mrb_value *v)
+{
+  const char *s = v->str;
+  const char *sep = NULL;
+  int len = strlen(s);
+  int seplen = 0;
+
+  if( v[1].tt == MRB_TT_STRING && !(v[1].str[0] == ' ' && v[1].str[1] == 0) ){
+    sep = v[1].str;
+    seplen = strlen(sep);
+  }
+
+  // count pieces, and make array.
+  int n = 0;
+  int made = 0;		// strings made in pass 1
+  int pass;
+  mrb_value *array = NULL;
+  for( pass = 0 ; pass < 2 ; pass++ ){
+    const char *p = s;
+    const char *end = s + len;
+    int i = 0;
+
+    while( p < end ){
+      const char *q;
+      if( sep == NULL ){
+	// whitespace
+	while( p < end && is_space(*p) ) p++;
+	if( p == end ) break;
+	q = p;
+	while( q < end && !is_space(*q) ) q++;
+      } else if( seplen == 0 ){
+	// each character
+	q = p + 1;
+      } else {
+	q = mrbc_string_search(p, end - p, sep, seplen);
+	if( q == NULL ) q = end;
+      }
+
+      if( pass == 1 ){
+	char *str = mrbc_string_substr(vm, (char *)p, 0, q - p);
+	if( str == NULL ) goto L_ENOMEM;
+	array[i+1].tt = MRB_TT_STRING;
+	array[i+1].str = str;
+	made++;
+      }
+      i++;
+      p = (q < end && sep) ? q + seplen : q;
+    }
+
+    if( pass == 0 ){
+      n = i;
+      array = (mrb_value *)mrbc_alloc(vm, sizeof(mrb_value)*(n+1));
+      if( array == NULL ) goto L_ENOMEM;
+      mrbc_set_tt(array, MRB_TT_ARRAY);
+    }
+  }
+
+  // remove trailing empty strings.
+  while( n > 0 && array[n].str[0] == 0 ){
+    mrbc_free(vm, array[n].str);
+    n--;
+  }
+  array[0].tt = MRB_TT_FIXNUM;
+  array[0].i = n;
+
+  v->tt = MRB_TT_ARRAY;
+  v->array = array;
+  return;
+
+ L_ENOMEM:
+  // free the pieces made so far, and return nil.
+  if( array ){
+    int j;
+    for( j = 1 ; j <= made ; j++ ){
+      mrbc_free(vm, array[j].str);
+    }
+    mrbc_free(vm, array);
+  }
+  SET_NIL_RETURN();
+}
+
+
+// method
+// string strip
+static void c_string_strip(mrb_vm *vm, mrb_value *v)
+{
+  const char *s = v->str;
+  int len = strlen(s);
+
+  while( len > 0 && (is_space(s[len-1]) || s[len-1] == 0) ) len--;
+  while( len > 0 && is_space(*s) ){
+    s++;
+    len--;
+  }
+
+  char *str = mrbc_string_substr(vm, (char *)s, 0, len);
+  if( str == NULL ) return;  // ENOMEM
+  v->str = str;
+}
+
+
+
+// method
+// string %
+//  "%d %s" % [1, "a"]
+static void c_string_format(mrb_vm *vm, mrb_value *v)
+{
+  char *str;
+  if( v[1].tt == MRB_TT_ARRAY ){
+    str = mrbc_string_format(vm, v->str, v[1].array + 1, v[1].array[0].i);
+  } else {
+    str = mrbc_string_format(vm, v->str, v + 1, 1);
+  }
+  if( str == NULL ){
+    SET_NIL_RETURN();
+    return;
+  }
+  v->str = str;
+}
+
+
 
 // init class
 void mrbc_init_class_string(mrb_vm *vm)
@@ -104,5 +775,17 @@ void mrbc_init_class_string(mrb_vm *vm)
   mrbc_define_method(vm, mrbc_class_string, "size", c_string_size);
   mrbc_define_method(vm, mrbc_class_string, "length", c_string_size);
   mrbc_define_method(vm, mrbc_class_string, "!=", c_string_neq);
-  mrbc_define_method(vm, mrbc_class_string, "to_i", c_string_to_fixnum);
+  mrbc_define_method(vm, mrbc_class_string, "to_i", c_string_to_i);
+#if MRBC_USE_FLOAT
+  mrbc_define_method(vm, mrbc_class_string, "to_f", c_string_to_f);
+#endif
+  mrbc_define_method(vm, mrbc_class_string, "==", c_string_eq);
+  mrbc_define_method(vm, mrbc_class_string, "index", c_string_index);
+  mrbc_define_method(vm, mrbc_class_string, "include?", c_string_include);
+  mrbc_define_method(vm, mrbc_class_string, "start_with?", c_string_start_with);
+  mrbc_define_method(vm, mrbc_class_string, "end_with?", c_string_end_with);
+  mrbc_define_method(vm, mrbc_class_string, "count", c_string_count);
+  mrbc_define_method(vm, mrbc_class_string, "split", c_string_split);
+  mrbc_define_method(vm, mrbc_class_string, "strip", c_string_strip);
+  mrbc_define_method(vm, mrbc_class_string, "%", c_string_format);
 }
@@ -27,6 +27,12 @@ void mrbc_init_class_string(mrb_vm *vm);
 
 char *mrbc_string_dup(mrb_vm *vm, const char *str);
 char *mrbc_string_cat(mrb_vm *vm, char *s1, const char *s2);
+char *mrbc_string_format(mrb_vm *vm, const char *fmt, mrb_value *v, int argc);
+char *mrbc_string_append(mrb_vm *vm, char *s1, mrb_value *v);
+int mrbc_string_to_i(const char *s, int base, int strict, int32_t *value);
+#if MRBC_USE_FLOAT
+double mrbc_string_to_f(const char *s);
+#endif
 
 #ifdef __cplusplus
 }
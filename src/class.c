@@ -20,6 +20,9 @@
 #include "c_hash.h"
 #include "c_numeric.h"
 #include "c_string.h"
+#include "c_json.h"
+#include "c_msgpack.h"
+#include "c_math.h"
 #include "c_symbol.h"
 #include "c_range.h"
 
@@ -43,6 +46,9 @@ mrb_class *find_class_by_object(mrb_vm *vm, mrb_object *obj)
     case MRB_TT_HASH:
       cls = mrbc_class_hash;
       break;
+    case MRB_TT_RANGE:
+      cls = mrbc_class_range;
+      break;
     case MRB_TT_FIXNUM:
       cls = mrbc_class_fixnum;
       break;
@@ -65,6 +71,12 @@ mrb_class *find_class_by_object(mrb_vm *vm, mrb_object *obj)
       cls = mrbc_class_string;
       break;
 #endif
+    case MRB_TT_OBJECT:
+      cls = obj->obj->cls;
+      break;
+    case MRB_TT_CLASS:
+      cls = obj->cls;
+      break;
     case MRB_TT_USERTOP:
       cls = vm->target_class;
     break;
@@ -178,6 +190,83 @@ void c_object_neq(mrb_vm *vm, mrb_value *v)
   }
 }
 
+// Object#freeze
+void c_object_freeze(mrb_vm *vm, mrb_value *v)
+{
+  if( mrbc_freeze(v) != 0 ){
+    console_printf("TypeError: can't freeze, refers Object or Proc\n");
+    SET_NIL_RETURN();
+  }
+}
+
+// Object#frozen?
+void c_object_frozen(mrb_vm *vm, mrb_value *v)
+{
+  if( mrbc_is_frozen_object(v) ){
+    SET_TRUE_RETURN();
+  } else {
+    SET_FALSE_RETURN();
+  }
+}
+
+#if MRBC_USE_STRING
+// Object#sprintf, format
+void c_object_sprintf(mrb_vm *vm, mrb_value *v)
+{
+  int argc = mrbc_get_argc(vm);
+  if( argc < 1 || v[1].tt != MRB_TT_STRING ){
+    console_printf("TypeError: format string required\n");
+    SET_NIL_RETURN();
+    return;
+  }
+
+  char *str = mrbc_string_format(vm, v[1].str, v + 2, argc - 1);
+  if( !str ){
+    SET_NIL_RETURN();
+    return;
+  }
+  v->tt = MRB_TT_STRING;
+  v->str = str;
+}
+
+// Object#Integer
+//  Integer(str)
+//  Integer(str, base)
+void c_object_integer(mrb_vm *vm, mrb_value *v)
+{
+  int32_t value;
+
+  switch( v[1].tt ){
+  case MRB_TT_FIXNUM:
+    SET_INT_RETURN(v[1].i);
+    return;
+#if MRBC_USE_FLOAT
+  case MRB_TT_FLOAT:
+    SET_INT_RETURN((int32_t)v[1].d);
+    return;
+#endif
+  case MRB_TT_STRING:{
+    int base = (v[2].tt == MRB_TT_FIXNUM) ? v[2].i : 0;
+    switch( mrbc_string_to_i(v[1].str, base, 1, &value) ){
+    case 0:
+      SET_INT_RETURN(value);
+      return;
+    case -2:
+      console_printf("RangeError: integer %s too big\n", v[1].str);
+      break;
+    default:
+      console_printf("ArgumentError: invalid value for Integer(): \"%s\"\n", v[1].str);
+      break;
+    }
+  } break;
+  default:
+    console_printf("TypeError: can't convert into Integer\n");
+    break;
+  }
+  SET_NIL_RETURN();
+}
+#endif
+
 static void mrbc_init_class_object(mrb_vm *vm)
 {
   // Class
@@ -185,6 +274,13 @@ static void mrbc_init_class_object(mrb_vm *vm)
   // Methods
   mrbc_define_method(vm, mrbc_class_object, "puts", c_puts);
   mrbc_define_method(vm, mrbc_class_object, "!=", c_object_neq);
+  mrbc_define_method(vm, mrbc_class_object, "freeze", c_object_freeze);
+  mrbc_define_method(vm, mrbc_class_object, "frozen?", c_object_frozen);
+#if MRBC_USE_STRING
+  mrbc_define_method(vm, mrbc_class_object, "sprintf", c_object_sprintf);
+  mrbc_define_method(vm, mrbc_class_object, "format", c_object_sprintf);
+  mrbc_define_method(vm, mrbc_class_object, "Integer", c_object_integer);
+#endif
 }
 
 
@@ -255,11 +351,16 @@ void mrbc_init_class(void)
   mrbc_init_class_symbol(0);
 #if MRBC_USE_FLOAT
   mrbc_init_class_float(0);
+#if MRBC_USE_MATH
+  mrbc_init_class_math(0);
+#endif
 #endif
 #if MRBC_USE_STRING
   mrbc_init_class_string(0);
+  mrbc_init_class_json(0);
 #endif
   mrbc_init_class_array(0);
   mrbc_init_class_range(0);
   mrbc_init_class_hash(0);
+  mrbc_init_class_msgpack(0);
 }
@@ -22,112 +22,255 @@
 #endif
 
 
+//================================================================
+/*! write to the output target
+
+  @param  out		output target, or NULL to console.
+  @param  s		data
+  @param  len		length
+*/
+static void format_write(mrbc_format_out *out, const char *s, int len)
+{
+  if( !out ) {
+    hal_write(1, s, len);
+    return;
+  }
+
+  int n = out->size - out->len;
+  if( n > len ) n = len;
+  if( n > 0 ) memcpy(out->buf + out->len, s, n);
+  out->len += len;
+}
+
+
+//================================================================
+/*! write padding characters
+
+  @param  out		output target, or NULL to console.
+  @param  pad		padding character
+  @param  n		number of characters
+*/
+static void format_pad(mrbc_format_out *out, char pad, int n)
+{
+  char buf[8];
+  memset(buf, pad, sizeof(buf));
+
+  while( n > 0 ) {
+    int len = n < sizeof(buf) ? n : sizeof(buf);
+    format_write(out, buf, len);
+    n -= len;
+  }
+}
+
+
+//================================================================
+/*! initialize the output target for a buffer
+
+  @param  out		output target
+  @param  buf		buffer, or NULL to count length only.
+  @param  size		buffer size
+*/
+void mrbc_format_init(mrbc_format_out *out, char *buf, int size)
+{
+  out->buf = buf;
+  out->size = buf ? size : 0;
+  out->len = 0;
+}
+
+
+//================================================================
+/*! output literal text and parse the next conversion specifier.
+
+  @param  out		output target, or NULL to console.
+  @param  fmt		format string
+  @param  spec		parsed specifier
+  @return		pointer to next of the specifier, or NULL if end.
+*/
+const char *mrbc_format_parse(mrbc_format_out *out, const char *fmt, mrbc_format_spec *spec)
+{
+  while( 1 ) {
+    const char *p = fmt;
+    while( *p && *p != '%' ) p++;
+    if( p != fmt ) format_write(out, fmt, p - fmt);
+    if( *p == '\0' ) return NULL;
+
+    fmt = p + 1;
+    if( *fmt == '%' ) {		// "%%"
+      format_write(out, fmt++, 1);
+      continue;
+    }
+    break;
+  }
+
+  spec->align = 1;
+  spec->pad = ' ';
+  spec->width = 0;
+  spec->precision = -1;
+
+  int c;
+  while( 1 ) {
+    switch( (c = *fmt++) ) {
+    case '-':
+      spec->align = -1;
+      break;
+
+    case '0':
+      if( spec->pad == ' ' && spec->width == 0 ) {
+        spec->pad = '0';
+        break;
+      }
+      // fall through.
+
+    case '1': case '2': case '3': case '4': case '5':
+    case '6': case '7': case '8': case '9':
+      spec->width = spec->width * 10 + (c - '0');
+      break;
+
+    case '.':
+      spec->precision = 0;
+      while( *fmt >= '0' && *fmt <= '9' ) {
+        spec->precision = spec->precision * 10 + (*fmt++ - '0');
+      }
+      break;
+
+    case '\0':
+      return NULL;
+
+    default:
+      spec->type = c;
+      return fmt;
+    }
+  }
+}
+
+
 //================================================================
 /*! output string with format
 
+  @param  out		output target, or NULL to console.
   @param  value		output value
-  @param  align		left(-1) or right(1)
-  @param  w		width
-  @param  base		n base
-  @param  pad		padding character
+  @param  spec		format specifier
 */
-static void format_output_str(const char *value, int align, int w, char pad)
+void mrbc_format_str(mrbc_format_out *out, const char *value, const mrbc_format_spec *spec)
 {
   if( !value ) return;
 
   int len = strlen(value);
-  int n_pad = w - len;
+  if( spec->precision >= 0 && spec->precision < len ) len = spec->precision;
+  int n_pad = spec->width - len;
 
-  if( align == 1 ) {
-    while( n_pad-- > 0 ) {
-      console_putchar(pad);
-    }
+  if( spec->align == 1 ) {
+    format_pad(out, spec->pad, n_pad);
   }
-  hal_write(1, value, len);
-  while( n_pad-- > 0 ) {
-    console_putchar(pad);
+  format_write(out, value, len);
+  if( spec->align != 1 ) {
+    format_pad(out, ' ', n_pad);
   }
 }
 
 
+//================================================================
+/*! output number string with format. sign aware zero padding.
+
+  @param  out		output target, or NULL to console.
+  @param  buf		number string
+  @param  spec		format specifier
+*/
+static void format_output_num(mrbc_format_out *out, const char *buf, const mrbc_format_spec *spec)
+{
+  if( *buf == '-' && spec->align == 1 && spec->pad == '0' ) {
+    mrbc_format_spec sp = *spec;
+    format_write(out, "-", 1);	// when "%08d",-12345 then "-0012345"
+    sp.width--;
+    sp.precision = -1;
+    mrbc_format_str(out, buf + 1, &sp);
+    return;
+  }
+
+  mrbc_format_spec sp = *spec;
+  sp.precision = -1;
+  mrbc_format_str(out, buf, &sp);
+}
+
+
 //================================================================
 /*! output int value with format
 
+  @param  out		output target, or NULL to console.
   @param  value		output value
-  @param  align		left(-1) or right(1)
-  @param  w		width
   @param  base		n base
-  @param  pad		padding character
+  @param  spec		format specifier
 */
-static void format_output_int(int32_t value, int align, int w, int base, char pad)
+void mrbc_format_int(mrbc_format_out *out, int32_t value, int base, const mrbc_format_spec *spec)
 {
-  char buf[21];
-  int sign = 0;
+  char buf[36];
   int idx = sizeof(buf);
+  uint32_t v = value < 0 ? -(uint32_t)value : value;
   buf[--idx] = 0;
 
-  if( value < 0 ) {
-    sign  = -1;
-    value = -value;
-  }
-
   do {
-    buf[--idx] = "0123456789ABCDEF"[value % base];
-    value /= base;
-  } while( value != 0 && idx != 0 );
+    buf[--idx] = "0123456789ABCDEF"[v % base];
+    v /= base;
+  } while( v != 0 && idx != 1 );
 
-  if( sign < 0 && align > 0 && pad == '0' ) {
-    console_putchar('-');	// when "%08d",-12345 then "-0012345"
-    w--;
-  } else if( sign < 0 && idx != 0 ) {
-    buf[--idx] = '-';
-  }
+  if( value < 0 ) buf[--idx] = '-';
 
-  format_output_str(buf + idx, align, w, pad);
+  format_output_num(out, buf + idx, spec);
 }
 
 
 //================================================================
 /*! output unsigned int value with format
 
+  @param  out		output target, or NULL to console.
   @param  value		output value
-  @param  align		left(-1) or right(1)
-  @param  w		width
   @param  base		n base
-  @param  pad		padding character
+  @param  spec		format specifier
 */
-static void format_output_uint(uint32_t value, int align, int w, int base, char pad)
+void mrbc_format_uint(mrbc_format_out *out, uint32_t value, int base, const mrbc_format_spec *spec)
 {
-  char buf[21];
+  const char *digit = (spec->type == 'x') ? "0123456789abcdef" : "0123456789ABCDEF";
+  char buf[36];
   int idx = sizeof(buf);
   buf[--idx] = 0;
 
   do {
-    buf[--idx] = "0123456789ABCDEF"[value % base];
+    buf[--idx] = digit[value % base];
     value /= base;
   } while( value != 0 && idx != 0 );
 
-  format_output_str(buf + idx, align, w, pad);
+  format_output_num(out, buf + idx, spec);
 }
 
 
 //================================================================
 /*! output double value with format
 
+  @param  out		output target, or NULL to console.
   @param  value		output value
-  @param  align		left(-1) or right(1)
-  @param  w		width
-  @param  pad		padding character
+  @param  spec		format specifier ('f', 'e', 'g' and capitals)
 */
 #if MRBC_USE_FLOAT
-static void format_output_float(double value, int align, int w, char pad)
+void mrbc_format_float(mrbc_format_out *out, double value, const mrbc_format_spec *spec)
 {
-  char buf[21];
-  sprintf(buf, "%f", value);
-  console_print(buf);
+  char fmt[] = "%.*f";
+  char buf[64];
+  int prec = spec->precision;
+
+  switch( spec->type ) {
+  case 'e': case 'E': case 'g': case 'G':
+    fmt[3] = spec->type;
+    break;
+  }
+  if( prec < 0 ) prec = 6;
+  if( prec > 20 ) prec = 20;
+
+  snprintf(buf, sizeof(buf), fmt, prec, value);
+  format_output_num(out, buf, spec);
 }
 #endif
 
+
 //================================================================
 /*! output a character
 
@@ -161,66 +304,35 @@ void console_printf(const char *fmt, ...)
   va_list params;
   va_start(params, fmt);
 
-  int c;
-  while((c = *fmt++)) {
-    if( c != '%' ) {
-      console_putchar(c);
-      continue;
-    }
-
-    int  align = 1;	// left(-1) or right(1)
-    char pad   = ' ';	// padding
-    int  w     = 0;	// width
-    while( 1 ) {
-      switch( (c = *fmt++) ) {
-      case '-':
-        align = -1;
-        break;
-
-      case '0':
-        if( pad == ' ' ) {
-          pad = '0';
-          break;
-        }
-	// fall through.
-
-      case '1': case '2': case '3': case '4': case '5':
-      case '6': case '7': case '8': case '9':
-        w = w * 10 + (c - '0');
-        break;
-
-      case '\0':
-	goto L_return;
-
-      default:
-        goto L_exit;
-      }
-    }
-
-L_exit:
-    switch(c) {
+  mrbc_format_spec spec;
+  while( (fmt = mrbc_format_parse(0, fmt, &spec)) != 0 ) {
+    switch( spec.type ) {
     case 's':
-      format_output_str(va_arg(params, char *), align, w, pad);
+      mrbc_format_str(0, va_arg(params, char *), &spec);
       break;
 
     case 'd':
     case 'i':
-      format_output_int(va_arg(params, int), align, w, 10, pad);
+      mrbc_format_int(0, va_arg(params, int), 10, &spec);
       break;
 
     case 'u':
-      format_output_uint(va_arg(params, unsigned int), align, w, 10, pad);
+      mrbc_format_uint(0, va_arg(params, unsigned int), 10, &spec);
       break;
 
     case 'X':
     case 'x':
-      format_output_uint(va_arg(params, unsigned int), align, w, 16, pad);
+      mrbc_format_uint(0, va_arg(params, unsigned int), 16, &spec);
       break;
 
 #if MRBC_USE_FLOAT
     case 'F':
     case 'f':
-      format_output_float(va_arg(params, double), align, w, pad);
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+      mrbc_format_float(0, va_arg(params, double), &spec);
       break;
 #endif
 
@@ -229,10 +341,9 @@ L_exit:
       break;
 
     default:
-      console_putchar(c);
+      console_putchar(spec.type);
     }
   }
 
-L_return:
   va_end(params);
 }
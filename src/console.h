@@ -15,10 +15,44 @@
 #ifndef MRBC_SRC_CONSOLE_H_
 #define MRBC_SRC_CONSOLE_H_
 
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+//================================================================
+/*!@brief
+  Output target of the format engine.
+  Output is truncated at size, but len counts the whole length.
+*/
+typedef struct RFormatOut {
+  char *buf;		//!< output buffer
+  int   size;		//!< buffer size
+  int   len;		//!< length of output
+} mrbc_format_out;
+
+
+//================================================================
+/*!@brief
+  Conversion specifier. (e.g. "%-8s" "%08.3f")
+*/
+typedef struct RFormatSpec {
+  char    type;		//!< conversion character
+  char    pad;		//!< padding character
+  int8_t  align;	//!< left(-1) or right(1)
+  int16_t width;
+  int16_t precision;	//!< -1 if not specified
+} mrbc_format_spec;
+
+
+void mrbc_format_init(mrbc_format_out *out, char *buf, int size);
+const char *mrbc_format_parse(mrbc_format_out *out, const char *fmt, mrbc_format_spec *spec);
+void mrbc_format_str(mrbc_format_out *out, const char *value, const mrbc_format_spec *spec);
+void mrbc_format_int(mrbc_format_out *out, int32_t value, int base, const mrbc_format_spec *spec);
+void mrbc_format_uint(mrbc_format_out *out, uint32_t value, int base, const mrbc_format_spec *spec);
+void mrbc_format_float(mrbc_format_out *out, double value, const mrbc_format_spec *spec);
+
 void console_putchar(const char c);
 void console_print(const char *str);
 void console_printf(const char *fmt, ...);
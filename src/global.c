@@ -2,6 +2,7 @@
 #include "value.h"
 #include "static.h"
 #include "vm_config.h"
+#include "vm.h"
 
 /*
 
@@ -95,3 +96,41 @@ mrb_object const_get(mrb_sym sym_id) {
     return obj;
   }
 }
+
+
+/* hand over objects owned by a VM */
+static void handover(mrb_globalobject *tbl, int size, struct VM *vm, struct VM *new_vm)
+{
+  int i;
+  for( i = 0; i < size; i++ ){
+    if( tbl[i].sym_id < 0 ) continue;
+
+    switch( mrbc_refers_vm(&tbl[i].obj, vm->vm_id) ){
+    case 0:
+      break;
+    case 1:
+      if( new_vm ){
+        mrbc_transfer_from(vm, new_vm, &tbl[i].obj);
+      } else {
+        tbl[i].obj.tt = MRB_TT_NIL;
+      }
+      break;
+    default:
+      // refers to objects or IREP of old VM, maybe in an Array or Hash.
+      tbl[i].obj.tt = MRB_TT_NIL;
+      break;
+    }
+  }
+}
+
+/*
+  Global objects and constants which refer memory of 'vm' are moved to
+  'new_vm', or cleared to nil if new_vm is NULL.
+  Values which are, or contain, classes, procs and objects of 'vm' are
+  always cleared, because they are released with the IREP of 'vm'.
+*/
+void global_object_handover(struct VM *vm, struct VM *new_vm)
+{
+  handover(mrbc_global, MAX_GLOBAL_OBJECT_SIZE, vm, new_vm);
+  handover((mrb_globalobject *)mrbc_const, MAX_CONST_COUNT, vm, new_vm);
+}
@@ -38,6 +38,9 @@ mrb_value global_object_get(mrb_sym sym_id);
 void const_add(mrb_sym sym_id, mrb_object *obj);
 mrb_object const_get(mrb_sym sym_id);
 
+struct VM;
+void global_object_handover(struct VM *vm, struct VM *new_vm);
+
 #ifdef __cplusplus
 }
 #endif
@@ -29,6 +29,7 @@
 /***** Local variables ******************************************************/
 #ifndef MRBC_NO_TIMER
 static sigset_t sigset_, sigset2_;
+static uint64_t last_tick_us_;
 #endif
 
 
@@ -39,10 +40,17 @@ static sigset_t sigset_, sigset2_;
 /*!@brief
   alarm signal handler
 
+  SIGALRMs may be merged while the signal is blocked or the process is
+  descheduled, so the number of ticks is taken from the monotonic clock.
 */
 static void sig_alarm(int dummy)
 {
-  mrbc_tick();
+  uint64_t now = hal_clock_us();
+
+  while( now - last_tick_us_ >= 1000 ) {
+    last_tick_us_ += 1000;
+    mrbc_tick();
+  }
 }
 
 
@@ -69,6 +77,7 @@ void hal_init(void)
   sa.sa_flags   = SA_RESTART;
   sa.sa_mask    = sigset_;
   sigaction(SIGALRM, &sa, 0);
+  last_tick_us_ = hal_clock_us();
 
   // タイマー設定
   struct itimerval tval;
@@ -21,6 +21,8 @@ extern "C" {
 
 /***** Feature test switches ************************************************/
 /***** System headers *******************************************************/
+#include <stdint.h>
+#include <time.h>
 #include <unistd.h>
 
 
@@ -49,6 +51,22 @@ void hal_disable_irq(void);
 
 /***** Inline functions *****************************************************/
 
+//================================================================
+/*!@brief
+  Read monotonic clock.
+
+  clock_gettime() is served by vDSO, so it does not enter the kernel.
+
+  @return       microseconds since unspecified starting point.
+*/
+inline static uint64_t hal_clock_us(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
 //================================================================
 /*!@brief
   Write
@@ -43,10 +43,14 @@ extern "C" {
 
 #endif
 
+// no free running counter. use tick counter. (1 tick = 1ms)
+# define hal_clock_us()    ((uint64_t)mrbc_get_tick() * 1000)
+
 
 /***** Typedefs *************************************************************/
 /***** Global variables *****************************************************/
 /***** Function prototypes **************************************************/
+uint32_t mrbc_get_tick(void);
 int hal_write(int fd, const void *buf, size_t nbytes);
 int hal_flush(int fd);
 
@@ -0,0 +1,46 @@
+/*! @file
+  @brief
+  Realtime multitask monitor for mruby/c
+  Hardware abstraction layer
+        for virtual clock (simulation and test)
+
+  <pre>
+  Copyright (C) 2016 Kyushu Institute of Technology.
+  Copyright (C) 2016 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+  </pre>
+*/
+
+/***** Feature test switches ************************************************/
+/***** System headers *******************************************************/
+/***** Local headers ********************************************************/
+#include "hal.h"
+
+
+/***** Constat values *******************************************************/
+/***** Macros ***************************************************************/
+/***** Typedefs *************************************************************/
+/***** Function prototypes **************************************************/
+/***** Local variables ******************************************************/
+/***** Global variables *****************************************************/
+/***** Signal catching functions ********************************************/
+/***** Local functions ******************************************************/
+/***** Global functions *****************************************************/
+
+//================================================================
+/*!@brief
+  idle CPU
+
+  All tasks are waiting or suspended. Advance the clock to the next
+  wakeup tick at once. If no task is waiting, advance one tick.
+*/
+void hal_idle_cpu(void)
+{
+  uint32_t n = mrbc_ticks_to_wakeup();
+  if( n == 0 ) n = 1;
+
+  while( n-- > 0 ) {
+    mrbc_tick();
+  }
+}
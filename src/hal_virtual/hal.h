@@ -0,0 +1,88 @@
+/*! @file
+  @brief
+  Realtime multitask monitor for mruby/c
+  Hardware abstraction layer
+        for virtual clock (simulation and test)
+
+  <pre>
+  Copyright (C) 2016 Kyushu Institute of Technology.
+  Copyright (C) 2016 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  Time does not follow the real clock. A tick is advanced after each
+  time slice, and when every task is waiting, the clock jumps straight
+  to the next wakeup tick. So runs are deterministic and as fast as
+  the CPU allows.
+  </pre>
+*/
+
+#ifndef MRBC_SRC_HAL_H_
+#define MRBC_SRC_HAL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***** Feature test switches ************************************************/
+// the clock is driven by the scheduler, not by a timer interrupt.
+#ifndef MRBC_NO_TIMER
+#define MRBC_NO_TIMER
+#endif
+
+
+/***** System headers *******************************************************/
+#include <stdint.h>
+#include <unistd.h>
+
+
+/***** Local headers ********************************************************/
+/***** Constant values ******************************************************/
+/***** Macros ***************************************************************/
+# define hal_init()        ((void)0)
+# define hal_enable_irq()  ((void)0)
+# define hal_disable_irq() ((void)0)
+# define hal_clock_us()    ((uint64_t)mrbc_get_tick() * 1000)
+
+
+/***** Typedefs *************************************************************/
+/***** Global variables *****************************************************/
+/***** Function prototypes **************************************************/
+void mrbc_tick(void);
+uint32_t mrbc_get_tick(void);
+uint32_t mrbc_ticks_to_wakeup(void);
+void hal_idle_cpu(void);
+
+
+/***** Inline functions *****************************************************/
+
+//================================================================
+/*!@brief
+  Write
+
+  @param  fd    dummy, but 1.
+  @param  buf   pointer of buffer.
+  @param  nbytes        output byte length.
+*/
+inline static int hal_write(int fd, const void *buf, size_t nbytes)
+{
+  return write(1, buf, nbytes);
+}
+
+
+//================================================================
+/*!@brief
+  Flush write baffer
+
+  @param  fd    dummy, but 1.
+*/
+inline static int hal_flush(int fd)
+{
+  return fsync(1);
+}
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif // ifndef MRBC_HAL_H_
@@ -20,6 +20,7 @@
 #include "errorcode.h"
 #include "static.h"
 #include "value.h"
+#include "alloc.h"
 
 
 //================================================================
@@ -67,6 +68,55 @@ static int load_header(struct VM *vm, const uint8_t **pos)
 }
 
 
+//================================================================
+/*!@brief
+  Find same literal in already loaded pools.
+
+  @param  vm    A pointer of VM.
+  @param  irep  A pointer of IREP which is loading now.
+  @param  n     number of loaded pool entries of irep.
+  @param  obj   A literal to find.
+  @return       A pointer of found pool object or NULL.
+*/
+static mrb_object *find_pool_object(struct VM *vm, mrb_irep *irep, int n,
+                                    const mrb_object *obj)
+{
+  mrb_irep *p;
+  for( p = vm->irep; p != 0; p = p->next ) {
+    int len = (p == irep) ? n : p->plen;
+    int i;
+    for( i = 0; i < len; i++ ) {
+      mrb_object *o = p->pools[i];
+      if( o->tt != obj->tt ) continue;
+
+      switch( obj->tt ) {
+#if MRBC_USE_STRING
+      case MRB_TT_STRING: {
+        // string length is stored just before the string in bytecode.
+        int len = bin_to_uint16(obj->str - 2);
+        if( bin_to_uint16(o->str - 2) == len &&
+            memcmp(o->str, obj->str, len) == 0 ) return o;
+      } break;
+#endif
+      case MRB_TT_FIXNUM:
+        if( o->i == obj->i ) return o;
+        break;
+#if MRBC_USE_FLOAT
+      case MRB_TT_FLOAT:
+        if( memcmp(&o->d, &obj->d, sizeof(double)) == 0 ) return o;
+        break;
+#endif
+      default:
+        break;
+      }
+    }
+    if( p == irep ) break;
+  }
+
+  return NULL;
+}
+
+
 //================================================================
 /*!@brief
   Parse IREP section.
@@ -154,43 +204,70 @@ static int load_irep(struct VM *vm, const uint8_t **pos)
     p += irep->ilen * 4;
 
     // POOL BLOCK
+    //  identical literals in all ireps share one pool object.
+    //  pools[] costs a pointer per entry, and saves an object per
+    //  duplicated literal. it pays if about a third are duplicated.
     irep->ptr_to_pool = 0;
+    irep->pools = 0;
+    irep->plen = 0;
     int plen = bin_to_uint32(p);    p += 4;
+    if( plen > 0 ) {
+      irep->pools = (mrb_object **)mrbc_alloc(0, sizeof(mrb_object *) * plen);
+      if( irep->pools == 0 ) {
+        vm->error_code = LOAD_FILE_IREP_ERROR_ALLOCATION;
+        return -1;
+      }
+    }
     int i;
     for( i=0 ; i<plen ; i++ ){
       int tt = *p++;
       int obj_size = bin_to_uint16(p);   p += 2;
-      mrb_object *ptr = mrbc_obj_alloc(0, MRB_TT_FALSE);
-      if( ptr == 0 ){
-        vm->error_code = LOAD_FILE_IREP_ERROR_ALLOCATION;
-	return -1;
-      }
+      mrb_object obj;
+      obj.tt = MRB_TT_FALSE;
       switch( tt ){
 #if MRBC_USE_STRING
         case 0: { // IREP_TT_STRING
-          ptr->tt = MRB_TT_STRING;
-	  ptr->str = (char*)p;
+          obj.tt = MRB_TT_STRING;
+	  obj.str = (char*)p;
         } break;
 #endif
         case 1: { // IREP_TT_FIXNUM
           char buf[obj_size+1];
           memcpy(buf, p, obj_size);
           buf[obj_size] = '\0';
-          ptr->tt = MRB_TT_FIXNUM;
-          ptr->i = atoi(buf);
+          obj.tt = MRB_TT_FIXNUM;
+          obj.i = atoi(buf);
         } break;
 #if MRBC_USE_FLOAT
         case 2: { // IREP_TT_FLOAT
           char buf[obj_size+1];
           memcpy(buf, p, obj_size);
           buf[obj_size] = '\0';
-          ptr->tt = MRB_TT_FLOAT;
-          ptr->d = atof(buf);
+          obj.tt = MRB_TT_FLOAT;
+          obj.d = atof(buf);
         } break;
 #endif
         default:
           break;
       }
+      p += obj_size;
+
+      mrb_object *ptr = find_pool_object(vm, irep, i, &obj);
+      irep->plen = i + 1;
+      if( ptr != 0 ){
+        irep->pools[i] = ptr;
+        continue;
+      }
+
+      ptr = mrbc_obj_alloc(0, obj.tt);
+      if( ptr == 0 ){
+        vm->error_code = LOAD_FILE_IREP_ERROR_ALLOCATION;
+	return -1;
+      }
+      *ptr = obj;
+      ptr->next = 0;
+      irep->pools[i] = ptr;
+
       if( irep->ptr_to_pool == 0 ){
         irep->ptr_to_pool = ptr;
       } else {
@@ -198,7 +275,6 @@ static int load_irep(struct VM *vm, const uint8_t **pos)
         while( pp->next != 0 ) pp = pp->next;
         pp->next = ptr;
       }
-      p += obj_size;
     }
 
     // SYMS BLOCK
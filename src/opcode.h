@@ -62,6 +62,7 @@ enum OPCODE {
   OP_JMPIF     = 0x18,
   OP_JMPNOT    = 0x19,
   OP_SEND      = 0x20,
+  OP_SENDB     = 0x21,
 
   OP_ENTER     = 0x26,
 
@@ -81,7 +82,7 @@ enum OPCODE {
   OP_ARRAY     = 0x37,
 
   OP_STRING    = 0x3d,
-
+  OP_STRCAT    = 0x3e,
   OP_HASH      = 0x3f,
   OP_LAMBDA    = 0x40,
   OP_RANGE     = 0x41,
@@ -23,17 +23,33 @@
 #include "load.h"
 #include "class.h"
 #include "vm.h"
+#include "global.h"
 #include "console.h"
+#include "symbol.h"
 #include "rrt0.h"
+#include "snapshot.h"
 #include "hal/hal.h"
 
 
 /***** Constat values *******************************************************/
 const int TIMESLICE_TICK = 10; // 10 * 1ms(HardwareTimer)  255 max
+const int TIMESLICE_TICK_MIN = 2;	// range of adaptive quantum.
+const int TIMESLICE_TICK_MAX = 100;
 
 
 /***** Macros ***************************************************************/
 /***** Typedefs *************************************************************/
+
+//================================================
+/*!@brief
+  Task object. (instance of class Task)
+*/
+typedef struct RTask {
+  mrb_object obj;	//!< obj.cls is class Task.
+  MrbcTcb   *tcb;
+} mrb_task;
+
+
 /***** Function prototypes **************************************************/
 /***** Local variables ******************************************************/
 static MrbcTcb *q_domant_;
@@ -41,11 +57,34 @@ static MrbcTcb *q_ready_;
 static MrbcTcb *q_waiting_;
 static MrbcTcb *q_suspended_;
 static volatile uint32_t tick_;
+static uint64_t slice_start_us_;
+static void (*budget_handler_)(MrbcTcb *tcb, int action);
+static mrb_class *class_task_;
 
 /***** Global variables *****************************************************/
 /***** Signal catching functions ********************************************/
 /***** Local functions ******************************************************/
 
+//================================================================
+/*! Compare the order of tasks in queue
+
+  @param        Pointer of TCB to insert
+  @param        Pointer of TCB in queue
+  @return       true if p_tcb should be placed before p.
+
+  priority_preemption順。同値のEDFタスク同士は、絶対デッドライン順。
+ */
+static inline int q_precede(const MrbcTcb *p_tcb, const MrbcTcb *p)
+{
+  if( p_tcb->priority_preemption != p->priority_preemption ) {
+    return p_tcb->priority_preemption < p->priority_preemption;
+  }
+
+  return p_tcb->flag_edf && p->flag_edf &&
+    (int32_t)(p_tcb->abs_deadline - p->abs_deadline) < 0;
+}
+
+
 //================================================================
 /*! Insert to task queue
 
@@ -55,6 +94,7 @@ static volatile uint32_t tick_;
   TCBはフリーの状態でなければならない。（別なQueueに入っていてはならない）
   Queueはpriority_preemption順にソート済みとなる。
   挿入するTCBとQueueに同じpriority_preemption値がある場合は、同値の最後に挿入される。
+  ただしEDFタスク同士は、絶対デッドラインの早い順に挿入される。
 
  */
 static void q_insert_task(MrbcTcb *p_tcb)
@@ -73,8 +113,7 @@ static void q_insert_task(MrbcTcb *p_tcb)
   }
 
   // case insert on top.
-  if((*pp_q == NULL) ||
-     (p_tcb->priority_preemption < (*pp_q)->priority_preemption)) {
+  if((*pp_q == NULL) || q_precede(p_tcb, *pp_q)) {
     p_tcb->next = *pp_q;
     *pp_q       = p_tcb;
     assert(p_tcb->next != p_tcb);
@@ -84,8 +123,7 @@ static void q_insert_task(MrbcTcb *p_tcb)
   // find insert point in sorted linked list.
   MrbcTcb *p = *pp_q;
   while( 1 ) {
-    if((p->next == NULL) ||
-       (p_tcb->priority_preemption < p->next->priority_preemption)) {
+    if((p->next == NULL) || q_precede(p_tcb, p->next)) {
       p_tcb->next = p->next;
       p->next     = p_tcb;
       assert(p->next != p);
@@ -140,6 +178,222 @@ static void q_delete_task(MrbcTcb *p_tcb)
 }
 
 
+//================================================================
+/*! Adapt quantum on voluntary yield
+
+  @param        Pointer of target TCB
+
+  自ら実行権を手放すタスクは対話的とみなし、タイムスライスを短くする。
+ */
+static void shrink_quantum(MrbcTcb *tcb)
+{
+  if( !tcb->flag_adaptive ) return;
+
+  int q = tcb->quantum - tcb->quantum / 4 - 1;
+  tcb->quantum = (q < TIMESLICE_TICK_MIN) ? TIMESLICE_TICK_MIN : q;
+}
+
+
+//================================================================
+/*! Adapt quantum on time slice expired
+
+  @param        Pointer of target TCB
+
+  タイムスライスを使い切るタスクはバッチ的とみなし、タイムスライスを長くする。
+ */
+static void grow_quantum(MrbcTcb *tcb)
+{
+  if( !tcb->flag_adaptive ) return;
+
+  int q = tcb->quantum + tcb->quantum / 2 + 1;
+  tcb->quantum = (q > TIMESLICE_TICK_MAX) ? TIMESLICE_TICK_MAX : q;
+}
+
+
+//================================================================
+/*! Start next budget period, if current one has passed
+
+  @param        Pointer of target TCB
+  @return       1 if priority is restored.
+
+  予算超過で降格されたタスクは、元の優先度に戻す。
+  割り込みコンテキストから呼ばれる。
+ */
+static int renew_budget(MrbcTcb *tcb)
+{
+  if( (int32_t)(tick_ - tcb->budget_start) < (int32_t)tcb->budget_period ) {
+    return 0;
+  }
+
+  int flag_demoted = (tcb->flag_budget_over == 2);
+  tcb->flag_budget_over = 0;
+  tcb->budget_start     = tick_;
+  tcb->budget_used      = 0;
+  if( !flag_demoted ) return 0;
+
+  q_delete_task(tcb);
+  tcb->priority_preemption = tcb->priority;
+  q_insert_task(tcb);
+  return 1;
+}
+
+
+//================================================================
+/*! Charge CPU budget to running task
+
+  @param        Pointer of target TCB
+
+  割り込みコンテキストから呼ばれる。予算超過の処置はmrbc_runで行う。
+ */
+static void charge_budget(MrbcTcb *tcb)
+{
+  if( tcb->flag_budget_over ) return;
+
+  if( ++tcb->budget_used >= tcb->budget ) {
+    tcb->flag_budget_over    = 1;
+    tcb->vm->flag_preemption = 1;
+  }
+}
+
+
+//================================================================
+/*! Take action on CPU budget exceeded
+
+  @param        Pointer of target TCB
+  @return       1 if task should be terminated.
+ */
+static int budget_over(MrbcTcb *tcb)
+{
+  tcb->flag_budget_over = 2;
+
+  switch( tcb->budget_action ) {
+  case BUDGET_DEMOTE:
+    hal_disable_irq();
+    q_delete_task(tcb);
+    tcb->priority_preemption = 255;
+    q_insert_task(tcb);
+    hal_enable_irq();
+    break;
+
+  case BUDGET_SUSPEND:
+    mrbc_suspend_task(tcb);
+    break;
+
+  default:
+    break;
+  }
+
+  if( budget_handler_ ) budget_handler_(tcb, tcb->budget_action);
+
+  return tcb->budget_action == BUDGET_KILL;
+}
+
+
+//================================================================
+/*! Close VM of the task
+
+  @param        Pointer of target TCB
+
+  子タスクはVM(IREP)を共有しているので、全ての子タスクのVMが
+  閉じられるまで、親タスクのVMは閉じない。
+  Task.newで生成されたタスクのTCBは、VMと共に解放する。
+ */
+static void close_task_vm(MrbcTcb *tcb)
+{
+  mrbc_vm_end(tcb->vm);
+  if( tcb->parent ) tcb->vm->irep = 0;	// IREP is owned by parent.
+  mrbc_vm_close(tcb->vm);
+  tcb->vm = 0;
+
+  MrbcTcb *parent = tcb->parent;
+  if( parent == NULL ) return;
+
+  // release TCB. the Task object in parent VM sees it as finished.
+  hal_disable_irq();
+  q_delete_task(tcb);
+  hal_enable_irq();
+  if( tcb->task ) tcb->task->tcb = 0;
+  mrbc_raw_free(tcb);
+
+  parent->n_children--;
+  if( parent->state == TASKSTATE_DOMANT && parent->n_children == 0 &&
+      parent->vm != NULL ) {
+    close_task_vm(parent);
+  }
+}
+
+
+//================================================================
+/*! Terminate the task
+
+  @param        Pointer of target TCB
+  @return       1 if there is no task to run.
+ */
+static int terminate_task(MrbcTcb *tcb)
+{
+  hal_disable_irq();
+  q_delete_task(tcb);
+  tcb->state = TASKSTATE_DOMANT;
+  q_insert_task(tcb);
+
+  // wakeup tasks which waiting this task in join.
+  MrbcTcb *t = q_suspended_;
+  while( t != NULL ) {
+    MrbcTcb *t_next = t->next;
+    if( t->join_target == tcb ) {
+      q_delete_task(t);
+      t->join_target = 0;
+      t->state       = TASKSTATE_READY;
+      q_insert_task(t);
+    }
+    t = t_next;
+  }
+  hal_enable_irq();
+
+  if( tcb->n_children == 0 ) close_task_vm(tcb);
+
+  return q_ready_ == NULL && q_waiting_ == NULL && q_suspended_ == NULL;
+}
+
+
+//================================================================
+/*! Swap bytecode of the task
+
+  @param        Pointer of target TCB
+  @retval 0     No error.
+  @retval -1    Error. The task keeps the old VM, if any.
+
+  タスクが実行中でない時点で呼ばれ、新しいVMで最初から実行し直す。
+ */
+static int swap_task_code(MrbcTcb *tcb)
+{
+  const uint8_t *vm_code = tcb->reload_code;
+  tcb->reload_code = 0;
+
+  mrb_vm *vm = mrbc_vm_open();
+  if( vm == NULL ) {
+    console_printf("Error: Can't open VM.\n");
+    return -1;
+  }
+  if( mrbc_load_mrb(vm, vm_code) != 0 ) {
+    console_printf("Error: Illegal bytecode.\n");
+    mrbc_vm_close(vm);
+    return -1;
+  }
+  mrbc_vm_begin(vm);
+
+  if( tcb->vm ) {
+    global_object_handover(tcb->vm,
+	   tcb->reload_policy == RELOAD_KEEP_GLOBALS ? vm : NULL);
+    mrbc_vm_end(tcb->vm);
+    mrbc_vm_close(tcb->vm);
+  }
+  tcb->vm        = vm;
+  tcb->timeslice = tcb->quantum;
+  return 0;
+}
+
+
 //================================================================
 /*! Find requested task
 
@@ -158,6 +412,25 @@ static inline MrbcTcb* find_requested_task(mrb_vm *vm)
 }
 
 
+//================================================================
+/*! Check that the task can block
+
+  @param        Pointer of vm
+  @param        method name, for error message
+  @return       1 if the task can block.
+
+  C関数（each等）から呼ばれたブロックの中では、C関数の状態がCの
+  スタックにあるため、タスクを切り替えられない。待たずにエラーとする。
+ */
+static int can_block(mrb_vm *vm, const char *name)
+{
+  if( vm->nested_call == 0 ) return 1;
+
+  console_printf("ThreadError: can't %s in a block called by C method\n", name);
+  return 0;
+}
+
+
 //================================================================
 /*! 一定時間停止（cruby互換）
 
@@ -167,6 +440,10 @@ static void c_sleep(mrb_vm *vm, mrb_value *v)
   MrbcTcb *tcb = find_requested_task(vm);
 
   if( tcb == NULL ) return;
+  if( !can_block(vm, "sleep") ) {
+    SET_NIL_RETURN();
+    return;
+  }
 
   switch( v[1].tt ) {
   case MRB_TT_FIXNUM:
@@ -177,82 +454,396 @@ static void c_sleep(mrb_vm *vm, mrb_value *v)
     mrbc_sleep_ms(tcb, (uint32_t)(GET_FLOAT_ARG(1) * 1000));
     break;
 
-  default:
+  default:
+
+    // TODO 引数なしの場合は永久停止
+    break;
+  }
+}
+
+
+//================================================================
+/*! 一定時間停止（ms単位）
+
+*/
+static void c_sleep_ms(mrb_vm *vm, mrb_value *v)
+{
+  MrbcTcb *tcb = find_requested_task(vm);
+
+  if( tcb == NULL ) return;
+  if( !can_block(vm, "sleep_ms") ) {
+    SET_NIL_RETURN();
+    return;
+  }
+
+  mrbc_sleep_ms(tcb, GET_INT_ARG(1));
+}
+
+
+//================================================================
+/*! 指定tickまで停止（絶対時刻）
+
+*/
+static void c_sleep_until(mrb_vm *vm, mrb_value *v)
+{
+  MrbcTcb *tcb = find_requested_task(vm);
+
+  if( tcb == NULL ) return;
+  if( !can_block(vm, "sleep_until") ) {
+    SET_NIL_RETURN();
+    return;
+  }
+
+  mrbc_sleep_until(tcb, GET_INT_ARG(1));
+}
+
+
+//================================================================
+/*! 周期タスクの周期設定（ms単位）
+
+*/
+static void c_set_period(mrb_vm *vm, mrb_value *v)
+{
+  MrbcTcb *tcb = find_requested_task(vm);
+
+  if( tcb == NULL ) return;
+
+  mrbc_set_period(tcb, GET_INT_ARG(1));
+}
+
+
+//================================================================
+/*! 次の周期まで停止
+
+  周期に間に合わなかった場合は停止せず false を返す。
+*/
+static void c_wait_period(mrb_vm *vm, mrb_value *v)
+{
+  MrbcTcb *tcb = find_requested_task(vm);
+
+  if( tcb == NULL ) return;
+  if( !can_block(vm, "wait_period") ) {
+    SET_NIL_RETURN();
+    return;
+  }
+
+  if( mrbc_wait_period(tcb) ) {
+    SET_TRUE_RETURN();
+  } else {
+    SET_FALSE_RETURN();
+  }
+}
+
+
+//================================================================
+/*! EDFスケジューリングクラスへ移行
+
+  set_edf(period_ms [, deadline_ms [, wcet_us]])
+  受入検査で不可となった場合は false を返す。
+*/
+static void c_set_edf(mrb_vm *vm, mrb_value *v)
+{
+  MrbcTcb *tcb = find_requested_task(vm);
+
+  if( tcb == NULL ) return;
+
+  uint32_t deadline = (GET_TT_ARG(2) == MRB_TT_FIXNUM) ? GET_INT_ARG(2) : 0;
+  uint32_t wcet_us = 0;
+  if( GET_TT_ARG(2) == MRB_TT_FIXNUM && GET_TT_ARG(3) == MRB_TT_FIXNUM ) {
+    wcet_us = GET_INT_ARG(3);
+  }
+  if( mrbc_set_edf(tcb, GET_INT_ARG(1), deadline, wcet_us) == 0 ) {
+    SET_TRUE_RETURN();
+  } else {
+    SET_FALSE_RETURN();
+  }
+}
+
+
+//================================================================
+/*! デッドラインミス回数を得る
+
+*/
+static void c_deadline_miss(mrb_vm *vm, mrb_value *v)
+{
+  MrbcTcb *tcb = find_requested_task(vm);
+
+  if( tcb == NULL ) return;
+
+  SET_INT_RETURN( tcb->deadline_miss );
+}
+
+
+//================================================================
+/*! CPU予算の設定
+
+  set_budget(budget_ms, period_ms [, :demote | :suspend | :kill])
+*/
+static void c_set_budget(mrb_vm *vm, mrb_value *v)
+{
+  MrbcTcb *tcb = find_requested_task(vm);
+
+  if( tcb == NULL ) return;
+
+  int action = BUDGET_DEMOTE;
+  if( GET_TT_ARG(3) == MRB_TT_SYMBOL ) {
+    const char *name = symid_to_str(GET_INT_ARG(3));
+    if( strcmp(name, "suspend") == 0 ) action = BUDGET_SUSPEND;
+    if( strcmp(name, "kill") == 0 ) action = BUDGET_KILL;
+  }
+
+  mrbc_set_budget(tcb, GET_INT_ARG(1), GET_INT_ARG(2), action);
+}
+
+
+//================================================================
+/*! タイムスライス変更（tick単位）
+
+*/
+static void c_set_timeslice(mrb_vm *vm, mrb_value *v)
+{
+  MrbcTcb *tcb = find_requested_task(vm);
+
+  if( tcb == NULL ) return;
+
+  mrbc_set_timeslice(tcb, GET_INT_ARG(1));
+}
+
+
+//================================================================
+/*! 適応的タイムスライスの設定
+
+*/
+static void c_adaptive_timeslice(mrb_vm *vm, mrb_value *v)
+{
+  MrbcTcb *tcb = find_requested_task(vm);
+
+  if( tcb == NULL ) return;
+
+  mrbc_set_adaptive_timeslice(tcb, GET_TT_ARG(1) != MRB_TT_FALSE &&
+			           GET_TT_ARG(1) != MRB_TT_NIL);
+}
+
+
+//================================================================
+/*! tickカウンタを得る
+
+*/
+static void c_get_tick(mrb_vm *vm, mrb_value *v)
+{
+  SET_INT_RETURN( (int32_t)mrbc_get_tick() );
+}
+
+
+//================================================================
+/*! 実行権を手放す
+
+*/
+static void c_relinquish(mrb_vm *vm, mrb_value *v)
+{
+  MrbcTcb *tcb = find_requested_task(vm);
+
+  if( tcb == NULL ) return;
+  if( !can_block(vm, "relinquish") ) {
+    SET_NIL_RETURN();
+    return;
+  }
+
+  mrbc_relinquish(tcb);
+}
+
+
+//================================================================
+/*! プライオリティー変更
+
+*/
+static void c_change_priority(mrb_vm *vm, mrb_value *v)
+{
+  MrbcTcb *tcb = find_requested_task(vm);
+
+  if( tcb == NULL ) return;
+
+  mrbc_change_priority(tcb, GET_INT_ARG(1));
+}
+
+
+//================================================================
+/*! 実行停止
+
+*/
+static void c_suspend_task(mrb_vm *vm, mrb_value *v)
+{
+  MrbcTcb *tcb = find_requested_task(vm);
+
+  if( tcb == NULL ) return;
+  if( !can_block(vm, "suspend_task") ) {
+    SET_NIL_RETURN();
+    return;
+  }
+
+  mrbc_suspend_task(tcb);
+}
+
+
+//================================================================
+/*! 実行再開
+
+*/
+static void c_resume_task(mrb_vm *vm, mrb_value *v)
+{
+  MrbcTcb *tcb = find_requested_task(vm);
+
+  if( tcb == NULL ) return;
+
+  // TODO: 未デバグ。引数で与えられたTCBのタスクを実行再開する。
+  mrbc_resume_task(tcb);
+}
+
+
+//================================================================
+/*! タスク生成（Task.new { ... }）
+
+  ブロックを、親タスクのIREPを共有する新しいタスクとして実行する。
+*/
+static void c_task_new(mrb_vm *vm, mrb_value *v)
+{
+  MrbcTcb *parent = find_requested_task(vm);
+
+  if( parent == NULL ) return;
+  if( GET_TT_ARG(1) != MRB_TT_PROC || GET_ARG(1).proc->c_func ) {
+    console_printf("Task.new: block required.\n");
+    SET_NIL_RETURN();
+    return;
+  }
+
+  // allocate instance of Task.
+  mrb_task *task = (mrb_task *)mrbc_alloc(vm, sizeof(mrb_task));
+  MrbcTcb *tcb = (MrbcTcb *)mrbc_raw_alloc(sizeof(MrbcTcb));
+  mrb_vm *child = mrbc_vm_open();
+  if( !task || !tcb || !child ) goto L_ENOMEM;
+
+  static const MrbcTcb init_val = MRBC_TCB_INITIALIZER;
+  *tcb = init_val;
+  tcb->vm                  = child;
+  tcb->parent              = parent;
+  tcb->priority            = parent->priority;
+  tcb->priority_preemption = parent->priority;
+  tcb->quantum             = TIMESLICE_TICK;
+  tcb->timeslice           = TIMESLICE_TICK;
+
+  // share the IREP and top level self with parent.
+  child->irep = vm->irep;
+  mrbc_vm_begin(child);
+  child->pc_irep      = GET_ARG(1).proc->func.irep;
+  child->target_class = vm->target_class;
+  child->top_self     = vm->top_self;
+  child->regs[0]      = vm->regs[0];
+  parent->n_children++;
+
+  mrbc_set_tt(task, MRB_TT_OBJECT);
+  task->obj.tt  = MRB_TT_OBJECT;
+  task->obj.cls = class_task_;
+  task->tcb     = tcb;
+  tcb->task     = task;
+
+  hal_disable_irq();
+  q_insert_task(tcb);
+  hal_enable_irq();
+
+  v[0].tt  = MRB_TT_OBJECT;
+  v[0].obj = &task->obj;
+  return;
 
-    // TODO 引数なしの場合は永久停止
-    break;
-  }
+ L_ENOMEM:
+  if( task ) mrbc_free(vm, task);
+  if( tcb ) mrbc_raw_free(tcb);
+  if( child ) mrbc_vm_close(child);
+  SET_NIL_RETURN();
 }
 
 
 //================================================================
-/*! 一定時間停止（ms単位）
+/*! タスクの終了を待つ（Task#join）
 
 */
-static void c_sleep_ms(mrb_vm *vm, mrb_value *v)
+static void c_task_join(mrb_vm *vm, mrb_value *v)
 {
   MrbcTcb *tcb = find_requested_task(vm);
 
   if( tcb == NULL ) return;
+  if( v[0].tt != MRB_TT_OBJECT ) return;
+  MrbcTcb *target = ((mrb_task *)v[0].obj)->tcb;
+  if( target == NULL ) return;		// already finished.
+  if( !can_block(vm, "join") ) {
+    SET_NIL_RETURN();
+    return;
+  }
 
-  mrbc_sleep_ms(tcb, GET_INT_ARG(1));
+  mrbc_join_task(tcb, target);
 }
 
 
 //================================================================
-/*! 実行権を手放す
+/*! タスクのキャンセル（Task#cancel）
 
 */
-static void c_relinquish(mrb_vm *vm, mrb_value *v)
+static void c_task_cancel(mrb_vm *vm, mrb_value *v)
 {
-  MrbcTcb *tcb = find_requested_task(vm);
-
-  if( tcb == NULL ) return;
+  if( v[0].tt != MRB_TT_OBJECT ) return;
+  MrbcTcb *target = ((mrb_task *)v[0].obj)->tcb;
+  if( target == NULL ) return;		// already finished.
 
-  mrbc_relinquish(tcb);
+  mrbc_cancel_task(target);
 }
 
 
 //================================================================
-/*! プライオリティー変更
+/*! タスクが実行中か？（Task#alive?）
 
 */
-static void c_change_priority(mrb_vm *vm, mrb_value *v)
+static void c_task_alive(mrb_vm *vm, mrb_value *v)
 {
-  MrbcTcb *tcb = find_requested_task(vm);
-
-  if( tcb == NULL ) return;
+  if( v[0].tt != MRB_TT_OBJECT ) return;
+  MrbcTcb *target = ((mrb_task *)v[0].obj)->tcb;
 
-  mrbc_change_priority(tcb, GET_INT_ARG(1));
+  if( target != NULL && target->state != TASKSTATE_DOMANT ) {
+    SET_TRUE_RETURN();
+  } else {
+    SET_FALSE_RETURN();
+  }
 }
 
 
 //================================================================
-/*! 実行停止
+/*! オブジェクトを送出（どのVMにも属さない状態にする）
 
+  別タスクが receive_object するまで、送出元VMの終了で解放されない。
+  ObjectやProcは送出元VMのクラスやIREPを参照するため、それらを含む
+  値は送出できない。
 */
-static void c_suspend_task(mrb_vm *vm, mrb_value *v)
+static void c_send_object(mrb_vm *vm, mrb_value *v)
 {
-  MrbcTcb *tcb = find_requested_task(vm);
-
-  if( tcb == NULL ) return;
-
-  mrbc_suspend_task(tcb);
+  if( mrbc_transfer(NULL, &v[1]) != 0 ) {
+    console_printf("TypeError: can't send Object or Proc\n");
+    SET_NIL_RETURN();
+    return;
+  }
+  SET_RETURN( v[1] );
 }
 
 
 //================================================================
-/*! 実行再開
+/*! オブジェクトを受け取る（このVMの所有にする）
 
 */
-static void c_resume_task(mrb_vm *vm, mrb_value *v)
+static void c_receive_object(mrb_vm *vm, mrb_value *v)
 {
-  MrbcTcb *tcb = find_requested_task(vm);
-
-  if( tcb == NULL ) return;
-
-  // TODO: 未デバグ。引数で与えられたTCBのタスクを実行再開する。
-  mrbc_resume_task(tcb);
+  if( mrbc_transfer(vm, &v[1]) != 0 ) {
+    console_printf("TypeError: can't receive Object or Proc\n");
+    SET_NIL_RETURN();
+    return;
+  }
+  SET_RETURN( v[1] );
 }
 
 
@@ -289,19 +880,41 @@ void mrbc_tick(void)
      (tcb->state == TASKSTATE_RUNNING) &&
      (tcb->timeslice > 0)) {
     tcb->timeslice--;
-    if( tcb->timeslice == 0 ) tcb->vm->flag_preemption = 1;
+    if( tcb->timeslice == 0 ) {
+      tcb->vm->flag_preemption = 1;
+      grow_quantum(tcb);
+    }
+  }
+
+  // 予算周期が過ぎたタスクの予算を戻す。降格されていれば元に戻す
+  // (実行中タスクの課金より先に行う)
+  tcb = q_ready_;
+  while( tcb != NULL ) {
+    MrbcTcb *t = tcb;
+    tcb = tcb->next;
+
+    if( t->budget != 0 && renew_budget(t) ) flag_preemption = 1;
+  }
+
+  // 実行中タスクのCPU予算を消費する
+  tcb = q_ready_;
+  if((tcb != NULL) &&
+     (tcb->state == TASKSTATE_RUNNING) &&
+     (tcb->budget != 0)) {
+    charge_budget(tcb);
   }
 
   // 待ちタスクキューから、ウェイクアップすべきタスクを探す
+  // (tickの取りこぼしとラップアラウンドに対応するため、差分で比較する)
   tcb = q_waiting_;
   while( tcb != NULL ) {
     MrbcTcb *t = tcb;
     tcb = tcb->next;
 
-    if( t->wakeup_tick == tick_ ) {
+    if( (int32_t)(tick_ - t->wakeup_tick) >= 0 ) {
       q_delete_task(t);
       t->state     = TASKSTATE_READY;
-      t->timeslice = TIMESLICE_TICK;
+      t->timeslice = t->quantum;
       q_insert_task(t);
       flag_preemption = 1;
     }
@@ -323,7 +936,13 @@ void mrbc_tick(void)
 */
 void mrbc_init(uint8_t *ptr, unsigned int size )
 {
+  q_domant_ = NULL;
+  q_ready_ = NULL;
+  q_waiting_ = NULL;
+  q_suspended_ = NULL;
+
   mrbc_init_alloc(ptr, size);
+  mrbc_init_vm();
   init_static();
   hal_init();
 
@@ -332,10 +951,27 @@ void mrbc_init(uint8_t *ptr, unsigned int size )
   //      不要な複雑さかもしれない。要リファクタリング。
   mrbc_define_method(0, mrbc_class_object, "sleep",           c_sleep);
   mrbc_define_method(0, mrbc_class_object, "sleep_ms",        c_sleep_ms);
+  mrbc_define_method(0, mrbc_class_object, "sleep_until",     c_sleep_until);
+  mrbc_define_method(0, mrbc_class_object, "set_period",      c_set_period);
+  mrbc_define_method(0, mrbc_class_object, "wait_period",     c_wait_period);
+  mrbc_define_method(0, mrbc_class_object, "get_tick",        c_get_tick);
+  mrbc_define_method(0, mrbc_class_object, "set_edf",         c_set_edf);
+  mrbc_define_method(0, mrbc_class_object, "deadline_miss",   c_deadline_miss);
+  mrbc_define_method(0, mrbc_class_object, "set_timeslice",   c_set_timeslice);
+  mrbc_define_method(0, mrbc_class_object, "adaptive_timeslice", c_adaptive_timeslice);
+  mrbc_define_method(0, mrbc_class_object, "set_budget",      c_set_budget);
   mrbc_define_method(0, mrbc_class_object, "relinquish",      c_relinquish);
   mrbc_define_method(0, mrbc_class_object, "change_priority", c_change_priority);
   mrbc_define_method(0, mrbc_class_object, "suspend_task",    c_suspend_task);
   mrbc_define_method(0, mrbc_class_object, "resume_task",     c_resume_task);
+  mrbc_define_method(0, mrbc_class_object, "send_object",     c_send_object);
+  mrbc_define_method(0, mrbc_class_object, "receive_object",  c_receive_object);
+
+  class_task_ = mrbc_class_alloc(0, "Task", mrbc_class_object);
+  mrbc_define_method(0, class_task_, "new",    c_task_new);
+  mrbc_define_method(0, class_task_, "join",   c_task_join);
+  mrbc_define_method(0, class_task_, "cancel", c_task_cancel);
+  mrbc_define_method(0, class_task_, "alive?", c_task_alive);
 }
 
 
@@ -358,7 +994,8 @@ MrbcTcb* mrbc_create_task(const uint8_t *vm_code, MrbcTcb *tcb)
     static const MrbcTcb init_val = MRBC_TCB_INITIALIZER;
     *tcb = init_val;
   }
-  tcb->timeslice           = TIMESLICE_TICK;
+  if( tcb->quantum == 0 ) tcb->quantum = TIMESLICE_TICK;
+  tcb->timeslice           = tcb->quantum;
   tcb->priority_preemption = tcb->priority;
 
   // assign VM on TCB
@@ -397,9 +1034,30 @@ int mrbc_run(void)
       continue;
     }
 
+    // キャンセル要求？
+    if( tcb->flag_cancel ) {
+      if( terminate_task(tcb) ) break;
+      continue;
+    }
+
+    // コード入れ替え要求？ (子タスクがIREPを共有している間は待つ)
+    if( tcb->reload_code && tcb->n_children == 0 ) {
+      if( swap_task_code(tcb) != 0 && tcb->vm == NULL ) {
+	// 終了済みタスクは起動できないので、休止状態に戻す
+	hal_disable_irq();
+	q_delete_task(tcb);
+	tcb->state = TASKSTATE_DOMANT;
+	q_insert_task(tcb);
+	hal_enable_irq();
+	if( q_ready_ == NULL && q_waiting_ == NULL && q_suspended_ == NULL ) break;
+	continue;
+      }
+    }
+
     // 実行開始
     tcb->state = TASKSTATE_RUNNING;
     int res = 0;
+    slice_start_us_ = hal_clock_us();
 
 #ifndef MRBC_NO_TIMER
     tcb->vm->flag_preemption = 0;
@@ -416,19 +1074,15 @@ int mrbc_run(void)
     mrbc_tick();
 #endif /* ifndef MRBC_NO_TIMER */
 
+    tcb->job_us += (uint32_t)(hal_clock_us() - slice_start_us_);
+
+    // CPU予算超過？
+    if( tcb->flag_budget_over == 1 && budget_over(tcb) ) res = -1;
+    if( tcb->flag_cancel ) res = -1;
+
     // タスク終了？
     if( res < 0 ) {
-      hal_disable_irq();
-      q_delete_task(tcb);
-      tcb->state = TASKSTATE_DOMANT;
-      q_insert_task(tcb);
-      hal_enable_irq();
-      mrbc_vm_end(tcb->vm);
-      mrbc_vm_close(tcb->vm);
-      tcb->vm = 0;
-
-      if( q_ready_ == NULL && q_waiting_ == NULL &&
-          q_suspended_ == NULL ) break;
+      if( terminate_task(tcb) ) break;
       continue;
     }
 
@@ -440,7 +1094,7 @@ int mrbc_run(void)
       // タイムスライス終了？
       if( tcb->timeslice == 0 ) {
         q_delete_task(tcb);
-        tcb->timeslice = TIMESLICE_TICK;
+        tcb->timeslice = tcb->quantum;
         q_insert_task(tcb); // insert task on queue last.
       }
     }
@@ -459,6 +1113,7 @@ void mrbc_sleep_ms(MrbcTcb *tcb, uint32_t ms)
 {
   hal_disable_irq();
   q_delete_task(tcb);
+  shrink_quantum(tcb);
   tcb->timeslice   = 0;
   tcb->state       = TASKSTATE_WAITING;
   tcb->wakeup_tick = tick_ + ms;
@@ -469,17 +1124,278 @@ void mrbc_sleep_ms(MrbcTcb *tcb, uint32_t ms)
 }
 
 
+//================================================================
+/*! 指定tickまで停止（絶対時刻）
+
+  @param  tcb		Pointer of target TCB
+  @param  tick		wakeup tick. if already passed, does not sleep.
+*/
+void mrbc_sleep_until(MrbcTcb *tcb, uint32_t tick)
+{
+  hal_disable_irq();
+  if( (int32_t)(tick - tick_) <= 0 ) {
+    hal_enable_irq();
+    return;
+  }
+  q_delete_task(tcb);
+  shrink_quantum(tcb);
+  tcb->timeslice   = 0;
+  tcb->state       = TASKSTATE_WAITING;
+  tcb->wakeup_tick = tick;
+  q_insert_task(tcb);
+  hal_enable_irq();
+
+  tcb->vm->flag_preemption = 1;
+}
+
+
+//================================================================
+/*! 周期タスクの周期設定
+
+  @param  tcb		Pointer of target TCB
+  @param  ms		period. 0 is stop periodic.
+
+  この時点を最初のリリース時刻とする。
+*/
+void mrbc_set_period(MrbcTcb *tcb, uint32_t ms)
+{
+  hal_disable_irq();
+  tcb->period       = ms;
+  tcb->release_tick = tick_;
+  hal_enable_irq();
+}
+
+
+//================================================================
+/*! EDFの受入検査
+
+  @param  tcb		Pointer of target TCB
+  @param  wcet_us	worst execution time of tcb (us).
+  @param  deadline	relative deadline of tcb (ms). not greater than period.
+  @retval 1		schedulable.
+  @retval 0		not schedulable.
+
+  全EDFタスクの密度 C/min(D,P) の和が1を超えなければ受け入れる。
+  割り込み禁止状態で呼ぶこと。
+*/
+static int edf_admit(const MrbcTcb *tcb, uint32_t wcet_us, uint32_t deadline)
+{
+  // density in 1/1000000.
+  uint64_t density = (uint64_t)wcet_us * 1000 / deadline;
+  MrbcTcb *queues[] = { q_ready_, q_waiting_, q_suspended_ };
+  int i;
+
+  for( i = 0; i < sizeof(queues) / sizeof(queues[0]); i++ ) {
+    const MrbcTcb *t;
+    for( t = queues[i]; t != NULL; t = t->next ) {
+      if( t == tcb || !t->flag_edf ) continue;
+      density += (uint64_t)t->wcet_us * 1000 / t->deadline;
+    }
+  }
+
+  return density <= 1000000;
+}
+
+
+//================================================================
+/*! 次の周期まで停止
+
+  リリース時刻は前回のリリース時刻に周期を足して求めるので、
+  処理時間による累積誤差は生じない。
+
+  @param  tcb		Pointer of target TCB
+  @retval 1		sleep until next release.
+  @retval 0		deadline missed, or not periodic task.
+*/
+int mrbc_wait_period(MrbcTcb *tcb)
+{
+  if( tcb->period == 0 ) return 0;
+
+  // ジョブの実行時間を計測
+  uint64_t now = hal_clock_us();
+  uint32_t job_us = tcb->job_us + (uint32_t)(now - slice_start_us_);
+  tcb->job_us = 0;
+  slice_start_us_ = now;
+
+  hal_disable_irq();
+  if( tcb->wcet_us < job_us ) {
+    tcb->wcet_us = job_us;
+    // 最悪実行時間が増えたので受入検査をやり直す。
+    if( tcb->flag_edf && !edf_admit(tcb, job_us, tcb->deadline) ) {
+      q_delete_task(tcb);
+      tcb->flag_edf = 0;
+      q_insert_task(tcb);
+    }
+  }
+
+  if( tcb->flag_edf ) {
+    if( (int32_t)(tick_ - tcb->abs_deadline) > 0 ) tcb->deadline_miss++;
+    // 絶対デッドラインが変わるので、Queue内の位置を直す。
+    q_delete_task(tcb);
+    tcb->abs_deadline = tcb->release_tick + tcb->period + tcb->deadline;
+    q_insert_task(tcb);
+  }
+
+  tcb->release_tick += tcb->period;
+  int missed = (int32_t)(tcb->release_tick - tick_) <= 0;
+  hal_enable_irq();
+  if( missed ) return 0;
+
+  mrbc_sleep_until(tcb, tcb->release_tick);
+  return 1;
+}
+
+
+//================================================================
+/*! EDFスケジューリングクラスへ移行
+
+  @param  tcb		Pointer of target TCB
+  @param  period	period (ms).
+  @param  deadline	relative deadline (ms). 0 is same as period.
+  @param  wcet_us	declared worst execution time (us). 0 is unknown.
+  @retval 0		No error.
+  @retval -1		Rejected by admission check.
+
+  申告または計測済みの最悪実行時間から全EDFタスクの密度を求め、
+  1を超える場合は受け入れない。受け入れ後も、計測した最悪実行時間が
+  増えるたびに wait_period で再検査し、不可となればEDFクラスから外す。
+*/
+int mrbc_set_edf(MrbcTcb *tcb, uint32_t period, uint32_t deadline, uint32_t wcet_us)
+{
+  if( period == 0 ) return -1;
+  if( deadline == 0 || deadline > period ) deadline = period;
+
+  hal_disable_irq();
+  if( tcb->wcet_us < wcet_us ) tcb->wcet_us = wcet_us;
+  if( !edf_admit(tcb, tcb->wcet_us, deadline) ) {
+    hal_enable_irq();
+    return -1;
+  }
+
+  q_delete_task(tcb);
+  tcb->flag_edf     = 1;
+  tcb->period       = period;
+  tcb->deadline     = deadline;
+  tcb->release_tick = tick_;
+  tcb->abs_deadline = tick_ + deadline;
+  q_insert_task(tcb);
+  hal_enable_irq();
+
+  return 0;
+}
+
+
+//================================================================
+/*! tickカウンタを得る
+
+  @return		tick counter. (1 tick = 1ms)
+*/
+uint32_t mrbc_get_tick(void)
+{
+  return tick_;
+}
+
+
+//================================================================
+/*! 次に起床するタスクまでのtick数を得る
+
+  @return		ticks until the earliest waiting task wakes up.
+  @retval 0		no task is waiting.
+*/
+uint32_t mrbc_ticks_to_wakeup(void)
+{
+  uint32_t min = 0;
+  MrbcTcb *t;
+
+  hal_disable_irq();
+  for( t = q_waiting_; t != NULL; t = t->next ) {
+    int32_t n = (int32_t)(t->wakeup_tick - tick_);
+    if( n < 1 ) n = 1;
+    if( min == 0 || n < min ) min = n;
+  }
+  hal_enable_irq();
+
+  return min;
+}
+
+
 //================================================================
 /*! 実行権を手放す
 
 */
 void mrbc_relinquish(MrbcTcb *tcb)
 {
+  shrink_quantum(tcb);
   tcb->timeslice           = 0;
   tcb->vm->flag_preemption = 1;
 }
 
 
+//================================================================
+/*! タイムスライスの変更
+
+  @param  tcb		Pointer of target TCB
+  @param  tick		length of time slice. (1..255)
+
+  適応的タイムスライスは解除される。
+*/
+void mrbc_set_timeslice(MrbcTcb *tcb, int tick)
+{
+  if( tick < 1 ) tick = 1;
+  if( tick > 255 ) tick = 255;
+
+  hal_disable_irq();
+  tcb->flag_adaptive = 0;
+  tcb->quantum       = tick;
+  if( tcb->timeslice > tick ) tcb->timeslice = tick;
+  hal_enable_irq();
+}
+
+
+//================================================================
+/*! 適応的タイムスライスの設定
+
+  @param  tcb		Pointer of target TCB
+  @param  flag		1: enable, 0: disable.
+*/
+void mrbc_set_adaptive_timeslice(MrbcTcb *tcb, int flag)
+{
+  tcb->flag_adaptive = !!flag;
+}
+
+
+//================================================================
+/*! CPU予算の設定
+
+  @param  tcb		Pointer of target TCB
+  @param  budget	CPU time (tick) allowed per period. 0 is unlimited.
+  @param  period	budget period (tick).
+  @param  action	enum MrbcBudgetAction
+*/
+void mrbc_set_budget(MrbcTcb *tcb, uint32_t budget, uint32_t period, int action)
+{
+  hal_disable_irq();
+  tcb->budget           = budget;
+  tcb->budget_period    = period;
+  tcb->budget_action    = action;
+  tcb->budget_start     = tick_;
+  tcb->budget_used      = 0;
+  tcb->flag_budget_over = 0;
+  hal_enable_irq();
+}
+
+
+//================================================================
+/*! CPU予算超過時に呼ばれる関数の設定
+
+  @param  func		handler. called from mrbc_run() after action taken.
+*/
+void mrbc_set_budget_handler(void (*func)(MrbcTcb *tcb, int action))
+{
+  budget_handler_ = func;
+}
+
+
 //================================================================
 /*! プライオリティーの変更
   TODO: No check, yet.
@@ -525,11 +1441,146 @@ void mrbc_resume_task(MrbcTcb *tcb)
 
   q_delete_task(tcb);
   tcb->state = TASKSTATE_READY;
+  if( tcb->flag_budget_over ) {
+    tcb->priority_preemption = tcb->priority;
+    tcb->flag_budget_over    = 0;
+    tcb->budget_start        = tick_;
+    tcb->budget_used         = 0;
+  }
   q_insert_task(tcb);
   hal_enable_irq();
 }
 
 
+//================================================================
+/*! タスクの終了を待つ
+
+  @param  tcb		Pointer of waiting TCB
+  @param  target	Pointer of target TCB
+  @retval 1		wait for target.
+  @retval 0		target has already finished.
+  @retval -1		tcb is in a block called by C function, and can't wait.
+*/
+int mrbc_join_task(MrbcTcb *tcb, MrbcTcb *target)
+{
+  if( target->state == TASKSTATE_DOMANT ) return 0;
+  if( tcb->vm->nested_call ) return -1;
+
+  tcb->join_target = target;
+  mrbc_suspend_task(tcb);
+  return 1;
+}
+
+
+//================================================================
+/*! タスクのキャンセル
+
+  @param  tcb		Pointer of target TCB
+
+  対象タスクは、次にスケジュールされた時点で終了する。
+*/
+void mrbc_cancel_task(MrbcTcb *tcb)
+{
+  hal_disable_irq();
+  switch( tcb->state ) {
+  case TASKSTATE_DOMANT:
+    break;
+
+  case TASKSTATE_RUNNING:
+    tcb->flag_cancel = 1;
+    tcb->vm->flag_preemption = 1;
+    break;
+
+  default:
+    tcb->flag_cancel = 1;
+    q_delete_task(tcb);
+    tcb->state       = TASKSTATE_READY;
+    tcb->join_target = 0;
+    q_insert_task(tcb);
+    break;
+  }
+  hal_enable_irq();
+}
+
+
+//================================================================
+/*! タスクのコード入れ替え（ホットリロード）
+
+  @param  tcb		Pointer of target TCB
+  @param  vm_code	pointer of new VM byte code.
+  @param  policy	enum MrbcReloadPolicy
+  @retval 0		No error.
+  @retval -1		Task created by Task.new, or finished task whose
+			VM is still shared by child tasks, can't be reloaded.
+
+  次にスケジュールされた時点で新しいコードに入れ替え、最初から実行する。
+  古いVMとIREPはその時点で解放される。終了したタスクは再起動される。
+*/
+int mrbc_reload_task(MrbcTcb *tcb, const uint8_t *vm_code, int policy)
+{
+  if( tcb->parent ) return -1;
+  if( tcb->state == TASKSTATE_DOMANT && tcb->n_children != 0 ) return -1;
+
+  hal_disable_irq();
+  tcb->reload_code   = vm_code;
+  tcb->reload_policy = policy;
+
+  if( tcb->state == TASKSTATE_RUNNING ) {
+    tcb->vm->flag_preemption = 1;
+  } else if( tcb->state != TASKSTATE_READY ) {
+    q_delete_task(tcb);
+    tcb->state       = TASKSTATE_READY;
+    tcb->join_target = 0;
+    q_insert_task(tcb);
+  }
+  hal_enable_irq();
+
+  return 0;
+}
+
+
+//================================================================
+/*! apply func to static variables, for snapshot.
+
+  @param  func	write or read function.
+  @param  arg	user argument.
+  @retval 0	No error.
+*/
+int mrbc_rrt0_snapshot(mrbc_snapshot_func func, void *arg)
+{
+  return func(&q_domant_, sizeof(q_domant_), arg) ||
+         func(&q_ready_, sizeof(q_ready_), arg) ||
+         func(&q_waiting_, sizeof(q_waiting_), arg) ||
+         func(&q_suspended_, sizeof(q_suspended_), arg) ||
+         func((void *)&tick_, sizeof(tick_), arg) ||
+         func(&budget_handler_, sizeof(budget_handler_), arg) ||
+         func(&class_task_, sizeof(class_task_), arg);
+}
+
+
+//================================================================
+/*! apply func to bytecode images used by tasks, for snapshot.
+
+  @param  func	function for each image.
+  @param  arg	user argument for func.
+
+  VMのバイトコードと、入れ替え待ちのバイトコード。重複することがある。
+*/
+void mrbc_rrt0_each_code(void (*func)(const uint8_t *mrb, void *arg), void *arg)
+{
+  MrbcTcb *queue[] = { q_domant_, q_ready_, q_waiting_, q_suspended_ };
+  int i;
+
+  for( i = 0; i < sizeof(queue) / sizeof(queue[0]); i++ ) {
+    MrbcTcb *tcb;
+    for( tcb = queue[i]; tcb != NULL; tcb = tcb->next ) {
+      if( tcb->vm && tcb->vm->mrb ) func(tcb->vm->mrb, arg);
+      if( tcb->reload_code ) func(tcb->reload_code, arg);
+    }
+  }
+}
+
+
 #ifdef MRBC_DEBUG
 
 //================================================================
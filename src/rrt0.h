@@ -37,6 +37,27 @@ enum MrbcTaskState {
 };
 
 
+//================================================
+/*!@brief
+  Action on CPU budget exceeded
+*/
+enum MrbcBudgetAction {
+  BUDGET_DEMOTE  = 0,	//!< lowest priority until next budget period.
+  BUDGET_SUSPEND = 1,	//!< suspend until resumed.
+  BUDGET_KILL    = 2,	//!< terminate task.
+};
+
+
+//================================================
+/*!@brief
+  Policy for global objects on hot reload
+*/
+enum MrbcReloadPolicy {
+  RELOAD_KEEP_GLOBALS  = 0,	//!< take over to new code.
+  RELOAD_RESET_GLOBALS = 1,	//!< clear to nil.
+};
+
+
 /***** Macros ***************************************************************/
 /***** Typedefs *************************************************************/
 
@@ -45,6 +66,7 @@ enum MrbcTaskState {
   Task control block
 */
 struct VM;
+struct RTask;
 typedef struct MrbcTcb {
   struct MrbcTcb *next;
   struct VM      *vm;
@@ -55,6 +77,29 @@ typedef struct MrbcTcb {
   union {
     uint32_t wakeup_tick;
   };
+  uint32_t        period;       //!< period of periodic task. 0 is not periodic.
+  uint32_t        release_tick; //!< last release tick of periodic task.
+  uint32_t        deadline;     //!< relative deadline of EDF task.
+  uint32_t        abs_deadline; //!< absolute deadline of current job.
+  uint32_t        job_us;       //!< execution time of current job.
+  uint32_t        wcet_us;      //!< declared or measured worst execution time of job.
+  uint16_t        deadline_miss;//!< count of deadline missed.
+  uint8_t         flag_edf;     //!< EDF scheduling class.
+  uint8_t         quantum;      //!< length of time slice (tick). 0 is default.
+  uint8_t         flag_adaptive;//!< adapt quantum to task behavior.
+  uint8_t         budget_action;//!< enum MrbcBudgetAction
+  uint8_t         flag_budget_over; //!< 1: detected, 2: action taken.
+  uint32_t        budget;       //!< CPU budget (tick) per budget_period. 0 is unlimited.
+  uint32_t        budget_period;
+  uint32_t        budget_start; //!< start tick of current budget period.
+  uint32_t        budget_used;  //!< used ticks in current budget period.
+  struct MrbcTcb *parent;       //!< task which created this task by Task.new
+  struct MrbcTcb *join_target;  //!< waiting for this task to finish.
+  uint16_t        n_children;   //!< number of child tasks which have VM.
+  uint8_t         flag_cancel;  //!< cancel requested.
+  uint8_t         reload_policy;//!< enum MrbcReloadPolicy
+  const uint8_t  *reload_code;  //!< new bytecode, waiting for swap.
+  struct RTask   *task;         //!< Task object made by Task.new.
 } MrbcTcb;
 
 #define MRBC_TCB_INITIALIZER { 0, 0, 128, 128, 0, TASKSTATE_READY }
@@ -67,10 +112,23 @@ void mrbc_init(uint8_t *ptr, unsigned int size );
 MrbcTcb *mrbc_create_task(const uint8_t *vm_code, MrbcTcb *tcb);
 int mrbc_run(void);
 void mrbc_sleep_ms(MrbcTcb *tcb, uint32_t ms);
+void mrbc_sleep_until(MrbcTcb *tcb, uint32_t tick);
+void mrbc_set_period(MrbcTcb *tcb, uint32_t ms);
+int mrbc_wait_period(MrbcTcb *tcb);
+int mrbc_set_edf(MrbcTcb *tcb, uint32_t period, uint32_t deadline, uint32_t wcet_us);
+void mrbc_set_timeslice(MrbcTcb *tcb, int tick);
+void mrbc_set_adaptive_timeslice(MrbcTcb *tcb, int flag);
+void mrbc_set_budget(MrbcTcb *tcb, uint32_t budget, uint32_t period, int action);
+void mrbc_set_budget_handler(void (*func)(MrbcTcb *tcb, int action));
+uint32_t mrbc_get_tick(void);
+uint32_t mrbc_ticks_to_wakeup(void);
 void mrbc_relinquish(MrbcTcb *tcb);
 void mrbc_change_priority(MrbcTcb *tcb, int priority);
 void mrbc_suspend_task(MrbcTcb *tcb);
 void mrbc_resume_task(MrbcTcb *tcb);
+int mrbc_join_task(MrbcTcb *tcb, MrbcTcb *target);
+void mrbc_cancel_task(MrbcTcb *tcb);
+int mrbc_reload_task(MrbcTcb *tcb, const uint8_t *vm_code, int policy);
 
 
 /***** Inline functions *****************************************************/
@@ -0,0 +1,236 @@
+/*! @file
+  @brief
+  Snapshot and restore the whole runtime state.
+
+  <pre>
+  Copyright (C) 2015-2016 Kyushu Institute of Technology.
+  Copyright (C) 2015-2016 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  A snapshot is the memory pool image and the static variables of
+  each module (free block index, symbol table, globals, classes,
+  VM id bitmap and task queues).
+
+  Objects in the pool hold C function pointers and pointers into the
+  bytecode images, which are not relocated. So a snapshot can be
+  restored only by the same program, with the same memory pool address
+  and the bytecode images at the same addresses.
+  The header records the pool address and size, a code and a data
+  address of this program, and the TCB and VM sizes. The address, size
+  and hash of each bytecode image used by tasks follow the header, and
+  are checked against the images given to mrbc_snapshot_restore().
+  A position independent executable is loaded at another address on
+  each run, so its snapshot can be restored only in the same run.
+  Tasks must use TCBs allocated by mrbc_create_task(), and mrbc_init()
+  must be called before restore.
+  </pre>
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include "snapshot.h"
+#include "alloc.h"
+#include "static.h"
+#include "vm.h"
+#include "rrt0.h"
+#include "hal/hal.h"
+
+
+#define SNAPSHOT_MAGIC "MRBCSNP2"
+
+/* maximum bytecode images. a VM and a pending reload per task. */
+#define SNAPSHOT_MAX_CODE (MAX_VM_COUNT * 2)
+
+//================================================================
+/*!@brief
+  Snapshot header
+*/
+typedef struct SNAPSHOT_HEADER {
+  char      magic[8];
+  uint32_t  pool_size;
+  uint16_t  sizeof_tcb;
+  uint16_t  sizeof_vm;
+  uintptr_t pool_addr;
+  uintptr_t code_addr;	// to detect other program, or ASLR.
+  uintptr_t data_addr;
+} SNAPSHOT_HEADER;
+
+
+//================================================================
+/*!@brief
+  Bytecode images used by tasks
+*/
+typedef struct SNAPSHOT_CODE {
+  uint16_t n;
+  struct {
+    uintptr_t addr;
+    uint32_t  size;
+    uint32_t  hash;
+  } image[SNAPSHOT_MAX_CODE];
+} SNAPSHOT_CODE;
+
+
+//================================================================
+/*! make header for current runtime.
+
+  @param  h	pointer to header.
+*/
+static void make_header(SNAPSHOT_HEADER *h)
+{
+  unsigned int size;
+
+  memset(h, 0, sizeof(SNAPSHOT_HEADER));
+  memcpy(h->magic, SNAPSHOT_MAGIC, sizeof(h->magic));
+  h->pool_addr  = (uintptr_t)mrbc_get_memory_pool(&size);
+  h->pool_size  = size;
+  h->sizeof_tcb = sizeof(MrbcTcb);
+  h->sizeof_vm  = sizeof(mrb_vm);
+  h->code_addr  = (uintptr_t)mrbc_snapshot_save;
+  h->data_addr  = (uintptr_t)mrbc_global;
+}
+
+
+//================================================================
+/*! get size and hash of a bytecode image.
+
+  @param  mrb	pointer to bytecode image.
+  @param  size	size is returned.
+  @return	FNV-1a hash of the image.
+*/
+static uint32_t code_hash(const uint8_t *mrb, uint32_t *size)
+{
+  uint32_t hash = 2166136261u;
+  uint32_t i;
+
+  *size = bin_to_uint32(mrb + 10);	// binary size in RITE header
+  for( i = 0; i < *size; i++ ) {
+    hash = (hash ^ mrb[i]) * 16777619u;
+  }
+  return hash;
+}
+
+
+// Internal use only
+// add a bytecode image to the list
+static void add_code(const uint8_t *mrb, void *arg)
+{
+  SNAPSHOT_CODE *c = (SNAPSHOT_CODE *)arg;
+  int i;
+
+  for( i = 0; i < c->n; i++ ) {
+    if( c->image[i].addr == (uintptr_t)mrb ) return;
+  }
+  if( c->n >= SNAPSHOT_MAX_CODE ) return;
+
+  c->image[c->n].addr = (uintptr_t)mrb;
+  c->image[c->n].hash = code_hash(mrb, &c->image[c->n].size);
+  c->n++;
+}
+
+
+//================================================================
+/*! check bytecode images against ones given by the application.
+
+  @param  c	images recorded in snapshot.
+  @param  code	bytecode images of the application.
+  @param  n_code num of code.
+  @retval 0	all images are found at the same address, and not changed.
+*/
+static int check_code(const SNAPSHOT_CODE *c, const uint8_t *const code[], int n_code)
+{
+  int i, j;
+
+  if( c->n > SNAPSHOT_MAX_CODE ) return -1;
+
+  for( i = 0; i < c->n; i++ ) {
+    for( j = 0; j < n_code; j++ ) {
+      if( (uintptr_t)code[j] == c->image[i].addr ) break;
+    }
+    if( j == n_code ) return -1;	// not given.
+
+    uint32_t size;
+    uint32_t hash = code_hash(code[j], &size);
+    if( size != c->image[i].size || hash != c->image[i].hash ) return -1;
+  }
+
+  return 0;
+}
+
+
+//================================================================
+/*! apply func to all state.
+
+  @param  func	write or read function.
+  @param  arg	user argument.
+  @retval 0	No error.
+*/
+static int walk_state(mrbc_snapshot_func func, void *arg)
+{
+  return mrbc_alloc_snapshot(func, arg) ||
+         mrbc_symbol_snapshot(func, arg) ||
+         mrbc_static_snapshot(func, arg) ||
+         mrbc_vm_snapshot(func, arg) ||
+         mrbc_rrt0_snapshot(func, arg);
+}
+
+
+//================================================================
+/*! save snapshot.
+
+  @param  write	function to write data.
+  @param  arg	user argument for write.
+  @retval 0	No error.
+  @retval -1	write error.
+
+  Call at a safe point. e.g. from a method called by a task, or
+  before mrbc_run().
+*/
+int mrbc_snapshot_save(mrbc_snapshot_func write, void *arg)
+{
+  SNAPSHOT_HEADER h;
+  SNAPSHOT_CODE c;
+  make_header(&h);
+  memset(&c, 0, sizeof(c));
+
+  hal_disable_irq();
+  mrbc_rrt0_each_code(add_code, &c);
+  int ret = write(&h, sizeof(h), arg) || write(&c, sizeof(c), arg) ||
+	    walk_state(write, arg);
+  hal_enable_irq();
+
+  return ret ? -1 : 0;
+}
+
+
+//================================================================
+/*! restore snapshot.
+
+  @param  read	function to read data.
+  @param  arg	user argument for read.
+  @param  code	bytecode images loaded by the application, at the
+		same addresses as when the snapshot was saved.
+  @param  n_code num of code.
+  @retval 0	No error. continue with mrbc_run().
+  @retval -1	not a snapshot of this runtime, or a bytecode image is
+		missing or changed. nothing changed.
+  @retval -2	read error. runtime is broken, call mrbc_init() again.
+*/
+int mrbc_snapshot_restore(mrbc_snapshot_func read, void *arg,
+			  const uint8_t *const code[], int n_code)
+{
+  SNAPSHOT_HEADER h, expect;
+  SNAPSHOT_CODE c;
+  make_header(&expect);
+
+  if( read(&h, sizeof(h), arg) != 0 ) return -1;
+  if( memcmp(&h, &expect, sizeof(h)) != 0 ) return -1;
+  if( read(&c, sizeof(c), arg) != 0 ) return -1;
+  if( check_code(&c, code, n_code) != 0 ) return -1;
+
+  hal_disable_irq();
+  int ret = walk_state(read, arg);
+  hal_enable_irq();
+
+  return ret ? -2 : 0;
+}
@@ -0,0 +1,53 @@
+/*! @file
+  @brief
+  Snapshot and restore the whole runtime state.
+
+  <pre>
+  Copyright (C) 2015-2016 Kyushu Institute of Technology.
+  Copyright (C) 2015-2016 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  </pre>
+*/
+
+#ifndef MRBC_SRC_SNAPSHOT_H_
+#define MRBC_SRC_SNAPSHOT_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//================================================================
+/*!@brief
+  Write (on save) or read (on restore) a memory region.
+
+  @param  ptr	pointer to the region.
+  @param  size	size of the region.
+  @param  arg	user argument.
+  @retval 0	No error.
+*/
+typedef int (*mrbc_snapshot_func)(void *ptr, unsigned int size, void *arg);
+
+
+int mrbc_snapshot_save(mrbc_snapshot_func write, void *arg);
+int mrbc_snapshot_restore(mrbc_snapshot_func read, void *arg,
+			  const uint8_t *const code[], int n_code);
+
+// apply func to static variables of each module.
+int mrbc_alloc_snapshot(mrbc_snapshot_func func, void *arg);
+int mrbc_symbol_snapshot(mrbc_snapshot_func func, void *arg);
+int mrbc_static_snapshot(mrbc_snapshot_func func, void *arg);
+int mrbc_vm_snapshot(mrbc_snapshot_func func, void *arg);
+int mrbc_rrt0_snapshot(mrbc_snapshot_func func, void *arg);
+
+// apply func to bytecode images used by tasks.
+void mrbc_rrt0_each_code(void (*func)(const uint8_t *mrb, void *arg), void *arg);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -14,6 +14,7 @@
 #include "vm_config.h"
 #include "class.h"
 #include "symbol.h"
+#include "snapshot.h"
 
 /* Static Variables */
 mrb_constobject mrbc_const[MAX_CONST_COUNT];
@@ -51,6 +52,31 @@ void init_static(void)
     mrbc_const[i].sym_id = -1;
   }
 
+  /* init symbol */
+  init_sym();
+
   /* init class */
   mrbc_init_class();
 }
+
+
+int mrbc_static_snapshot(mrbc_snapshot_func func, void *arg)
+{
+  return func(mrbc_const, sizeof(mrbc_const), arg) ||
+         func(mrbc_global, sizeof(mrbc_global), arg) ||
+         func(&mrbc_class_object, sizeof(mrb_class *), arg) ||
+         func(&mrbc_class_false, sizeof(mrb_class *), arg) ||
+         func(&mrbc_class_true, sizeof(mrb_class *), arg) ||
+         func(&mrbc_class_nil, sizeof(mrb_class *), arg) ||
+         func(&mrbc_class_array, sizeof(mrb_class *), arg) ||
+         func(&mrbc_class_fixnum, sizeof(mrb_class *), arg) ||
+         func(&mrbc_class_symbol, sizeof(mrb_class *), arg) ||
+#if MRBC_USE_FLOAT
+         func(&mrbc_class_float, sizeof(mrb_class *), arg) ||
+#endif
+#if MRBC_USE_STRING
+         func(&mrbc_class_string, sizeof(mrb_class *), arg) ||
+#endif
+         func(&mrbc_class_range, sizeof(mrb_class *), arg) ||
+         func(&mrbc_class_hash, sizeof(mrb_class *), arg);
+}
@@ -14,18 +14,49 @@
 #include <string.h>
 #include "symbol.h"
 #include "console.h"
+#include "alloc.h"
+#include "snapshot.h"
 
 
 struct SYM_INDEX {
   uint16_t hash;	//!< hash value, returned by calc_hash().
-  char    *pos;		//!< point to the symbol string. maybe in sym_table[].
+  char    *pos;		//!< point to the symbol string. in a string chunk.
 };
 
 
-static struct SYM_INDEX sym_index[MAX_SYMBOLS_COUNT];
+/*
+  Symbol strings are stored in chunks allocated from the memory pool.
+  A chunk is never moved or released, so the pointers returned by
+  symid_to_str() are stable. sym_index[] (sym_id -> string) and
+  sym_hash[] (open addressing hash table, hash -> sym_id) are
+  re-allocated twice as large when they become full.
+*/
+static struct SYM_INDEX *sym_index;	// sym_id -> symbol string.
 static int sym_index_pos;	// point to the last(free) sym_index array.
-static char  sym_table[MAX_SYMBOLS_SIZE];	// symbol string table.
-static char *sym_table_pos = sym_table;	// point to the last(free) sym_table.
+static int sym_index_size;	// allocated size of sym_index.
+static mrb_sym *sym_hash;	// hash table. -1 is empty.
+static int sym_hash_size;	// allocated size of sym_hash. power of 2.
+static char *sym_table_pos;	// point to the last(free) in current chunk.
+static char *sym_table_end;	// end of current chunk.
+
+#define SYM_ID_MAX INT16_MAX
+
+
+//================================================================
+/*! Initialize the symbol table.
+
+  Forget all symbols. the memory pool must be initialized with it.
+*/
+void init_sym(void)
+{
+  sym_index = NULL;
+  sym_index_pos = 0;
+  sym_index_size = 0;
+  sym_hash = NULL;
+  sym_hash_size = 0;
+  sym_table_pos = NULL;
+  sym_table_end = NULL;
+}
 
 
 //================================================================
@@ -46,6 +77,75 @@ static uint16_t calc_hash(const char *str)
 }
 
 
+//================================================================
+/*! Search symbol in hash table.
+
+  @param  str		Target string.
+  @param  h		Hash value of str.
+  @return int		Index of sym_hash. it's empty slot if not found.
+*/
+static int search_hash(const char *str, uint16_t h)
+{
+  int mask = sym_hash_size - 1;
+  int i = h & mask;
+
+  while( sym_hash[i] >= 0 ) {
+    struct SYM_INDEX *p = &sym_index[ sym_hash[i] ];
+    if( p->hash == h && strcmp(str, p->pos) == 0 ) break;
+    i = (i + 1) & mask;
+  }
+  return i;
+}
+
+
+//================================================================
+/*! Re-allocate hash table, and re-hash all symbols.
+
+  @param  size		New size. power of 2.
+  @retval 0		No error.
+*/
+static int resize_hash(int size)
+{
+  mrb_sym *new_hash = (mrb_sym *)mrbc_raw_alloc( sizeof(mrb_sym) * size );
+  if( new_hash == NULL ) return -1;  // ENOMEM
+
+  if( sym_hash ) mrbc_raw_free( sym_hash );
+  sym_hash = new_hash;
+  sym_hash_size = size;
+  memset( sym_hash, 0xff, sizeof(mrb_sym) * size );
+
+  int i;
+  for( i = 0; i < sym_index_pos; i++ ) {
+    sym_hash[ search_hash(sym_index[i].pos, sym_index[i].hash) ] = i;
+  }
+  return 0;
+}
+
+
+//================================================================
+/*! Store symbol string into chunk.
+
+  @param  str		Target string.
+  @param  len		Length of str, include '\0'.
+  @return char *	Pointer to stored string.
+*/
+static char *store_string(const char *str, int len)
+{
+  if( len > sym_table_end - sym_table_pos ) {
+    int size = (len > MAX_SYMBOLS_SIZE) ? len : MAX_SYMBOLS_SIZE;
+    char *chunk = (char *)mrbc_raw_alloc( size );
+    if( chunk == NULL ) return NULL;  // ENOMEM
+    sym_table_pos = chunk;
+    sym_table_end = chunk + size;
+  }
+
+  char *pos = sym_table_pos;
+  memcpy(pos, str, len);
+  sym_table_pos += len;
+  return pos;
+}
+
+
 //================================================================
 /*! Add symbol to symbol table.
 
@@ -56,31 +156,50 @@ static uint16_t calc_hash(const char *str)
 mrb_sym add_sym(const char *str)
 {
   mrb_sym sym_id = str_to_symid(str);
+  if( sym_id >= 0 ) return sym_id;
+
+  int len = strlen(str);
+  if( len == 0 ) return -1;
+  len++;
+
+  // check overflow.
+  if( sym_index_pos >= SYM_ID_MAX ) {
+    console_printf( "Overflow %s '%s'\n", "symbol id", str );
+    return -1;
+  }
 
-  if( sym_id < 0 ) {
-    // check overflow.
-    if( sym_index_pos >= MAX_SYMBOLS_COUNT ) {
-      console_printf( "Overflow %s '%s'\n", "MAX_SYMBOLS_COUNT", str );
-      return -1;
-    }
-    int len = strlen(str);
-    if( len == 0 ) return -1;
-    len++;
-    if( len > (MAX_SYMBOLS_SIZE - (sym_table_pos - sym_table)) ) {
-      console_printf( "Overflow %s '%s'\n", "MAX_SYMBOLS_SIZE", str );
-      return -1;
-    }
-
-    // ok! go.
-    sym_index[sym_index_pos].hash = calc_hash(str);
-    sym_index[sym_index_pos].pos = sym_table_pos;
-    sym_id = sym_index_pos;
-    sym_index_pos++;
-    memcpy(sym_table_pos, str, len);
-    sym_table_pos += len;
+  // expand index and hash table.
+  if( sym_index_pos >= sym_index_size ) {
+    int size = sym_index_size ? sym_index_size * 2 : MAX_SYMBOLS_COUNT;
+    struct SYM_INDEX *p = sym_index ?
+      (struct SYM_INDEX *)mrbc_raw_realloc( sym_index, sizeof(struct SYM_INDEX) * size ) :
+      (struct SYM_INDEX *)mrbc_raw_alloc( sizeof(struct SYM_INDEX) * size );
+    if( p == NULL ) goto L_ENOMEM;
+    sym_index = p;
+    sym_index_size = size;
+  }
+  if( (sym_index_pos + 1) * 2 > sym_hash_size ) {
+    int size = 16;
+    while( size < (sym_index_pos + 1) * 2 ) size <<= 1;
+    if( resize_hash(size) != 0 ) goto L_ENOMEM;
   }
 
+  char *pos = store_string(str, len);
+  if( pos == NULL ) goto L_ENOMEM;
+
+  // ok! go.
+  uint16_t h = calc_hash(str);
+  sym_id = sym_index_pos;
+  sym_index[sym_id].hash = h;
+  sym_index[sym_id].pos = pos;
+  sym_hash[ search_hash(str, h) ] = sym_id;
+  sym_index_pos++;
+
   return sym_id;
+
+ L_ENOMEM:
+  console_printf( "Overflow %s '%s'\n", "symbol table", str );
+  return -1;
 }
 
 
@@ -92,17 +211,9 @@ mrb_sym add_sym(const char *str)
 */
 mrb_sym str_to_symid(const char *str)
 {
-  uint16_t h = calc_hash(str);
-  int i;
+  if( sym_hash == NULL ) return -1;
 
-  for( i = 0; i < sym_index_pos; i++ ) {
-    if( sym_index[i].hash == h ) {
-      if( strcmp(str, sym_index[i].pos) == 0 ) {
-        return i;
-      }
-    }
-  }
-  return -1;
+  return sym_hash[ search_hash(str, calc_hash(str)) ];
 }
 
 
@@ -120,3 +231,22 @@ const char* symid_to_str(mrb_sym sym_id)
 
   return sym_index[sym_id].pos;
 }
+
+
+//================================================================
+/*! apply func to static variables, for snapshot.
+
+  @param  func	write or read function.
+  @param  arg	user argument.
+  @retval 0	No error.
+*/
+int mrbc_symbol_snapshot(mrbc_snapshot_func func, void *arg)
+{
+  return func(&sym_index, sizeof(sym_index), arg) ||
+         func(&sym_index_pos, sizeof(sym_index_pos), arg) ||
+         func(&sym_index_size, sizeof(sym_index_size), arg) ||
+         func(&sym_hash, sizeof(sym_hash), arg) ||
+         func(&sym_hash_size, sizeof(sym_hash_size), arg) ||
+         func(&sym_table_pos, sizeof(sym_table_pos), arg) ||
+         func(&sym_table_end, sizeof(sym_table_end), arg);
+}
@@ -20,6 +20,7 @@
 extern "C" {
 #endif
 
+void init_sym(void);
 mrb_sym add_sym(const char *str);
 mrb_sym str_to_symid(const char *str);
 const char* symid_to_str(mrb_sym sym_id);
@@ -5,11 +5,18 @@
 #include "symbol.h"
 #include "alloc.h"
 #include "vm.h"
+#include "c_hash.h"
+
+/* maximum nesting of objects, looked by mrbc_refers_vm() */
+#ifndef WALK_MAX_DEPTH
+#define WALK_MAX_DEPTH 32
+#endif
 
 mrb_object *mrbc_obj_alloc(mrb_vm *vm, mrb_vtype tt)
 {
   mrb_object *ptr = (mrb_object *)mrbc_alloc(vm, sizeof(mrb_object));
   if( ptr ){
+    mrbc_set_tt(ptr, tt);
     ptr->tt = tt;
     ptr->next = 0;
   }
@@ -21,6 +28,7 @@ mrb_class *mrbc_class_alloc(mrb_vm *vm, const char *name, mrb_class *super)
   mrb_class *ptr = (mrb_class *)mrbc_alloc(vm, sizeof(mrb_class));
   mrb_value v;
   if( ptr ){
+    mrbc_set_tt(ptr, MRB_TT_CLASS);
     // new class
     mrb_sym sym_id = add_sym(name);
     ptr->super = super;
@@ -39,6 +47,7 @@ mrb_proc *mrbc_rproc_alloc(mrb_vm *vm, const char *name)
 {
   mrb_proc *ptr = (mrb_proc *)mrbc_alloc(vm, sizeof(mrb_proc));
   if( ptr ) {
+    mrbc_set_tt(ptr, MRB_TT_PROC);
     ptr->sym_id = add_sym(name);
     ptr->next = 0;
   }
@@ -94,3 +103,404 @@ int mrbc_eq(mrb_value *v1, mrb_value *v2)
     return 0;
   }
 }
+
+
+// compare two objects
+// v1 < v2: return negative
+// v1 == v2: return 0
+// v1 > v2: return positive
+int mrbc_compare(mrb_value *v1, mrb_value *v2)
+{
+#if MRBC_USE_FLOAT
+  // Fixnum and Float
+  if( (v1->tt == MRB_TT_FIXNUM || v1->tt == MRB_TT_FLOAT) &&
+      (v2->tt == MRB_TT_FIXNUM || v2->tt == MRB_TT_FLOAT) &&
+      v1->tt != v2->tt ){
+    double d1 = (v1->tt == MRB_TT_FIXNUM) ? v1->i : v1->d;
+    double d2 = (v2->tt == MRB_TT_FIXNUM) ? v2->i : v2->d;
+    return (d1 > d2) - (d1 < d2);
+  }
+#endif
+
+  // TT_XXX is different, order by type.
+  if( v1->tt != v2->tt ) return v1->tt - v2->tt;
+
+  switch( v1->tt ){
+  case MRB_TT_FIXNUM:
+  case MRB_TT_SYMBOL:
+    return (v1->i > v2->i) - (v1->i < v2->i);
+  case MRB_TT_FLOAT:
+    return (v1->d > v2->d) - (v1->d < v2->d);
+  case MRB_TT_STRING:
+    return strcmp(v1->str, v2->str);
+  case MRB_TT_ARRAY: {
+    mrb_value *array1 = v1->obj;
+    mrb_value *array2 = v2->obj;
+    int i, len = array1[0].i < array2[0].i ? array1[0].i : array2[0].i;
+    for( i=1 ; i<=len ; i++ ){
+      int res = mrbc_compare(array1+i, array2+i);
+      if( res != 0 ) return res;
+    }
+    return array1[0].i - array2[0].i;
+  }
+  default:
+    return 0;
+  }
+}
+
+
+//================================================================
+/*! re-tag one memory block
+
+  @param  ptr	pointer to memory block.
+  @param  vm_id	new owner.
+  @retval 0	already owned by vm_id, frozen, or not a pool block.
+*/
+static int transfer_block(void *ptr, int vm_id)
+{
+  if( ptr == NULL || !mrbc_is_pool_ptr(ptr) ) return 0;
+  if( mrbc_is_frozen(ptr) ) return 0;
+  if( mrbc_get_vm_id(ptr) == vm_id ) return 0;
+
+  mrbc_set_vm_id(ptr, vm_id);
+  return 1;
+}
+
+
+//================================================================
+/*! change owner of one memory block, only if owned by specified VM.
+
+  @param  ptr	pointer to memory block.
+  @param  ids	(old vm_id << 8) | new vm_id
+  @retval 0	not owned by old VM, frozen, or not a pool block.
+  @retval 1	changed.
+*/
+static int transfer_block_from(void *ptr, int ids)
+{
+  if( ptr == NULL || !mrbc_is_pool_ptr(ptr) ) return 0;
+  if( mrbc_is_frozen(ptr) ) return 0;
+  if( mrbc_get_vm_id(ptr) != (ids >> 8) ) return 0;
+
+  mrbc_set_vm_id(ptr, ids & 0xff);
+  return 1;
+}
+
+
+//================================================================
+/*! freeze one memory block, and move it to shared area (vm_id 0).
+
+  @param  ptr	pointer to memory block.
+  @param  dummy	unused.
+  @retval 0	already frozen, or not a pool block.
+*/
+static int freeze_block(void *ptr, int dummy)
+{
+  if( ptr == NULL || !mrbc_is_pool_ptr(ptr) ) return 0;
+  if( mrbc_is_frozen(ptr) ) return 0;
+
+  mrbc_set_vm_id(ptr, 0);
+  mrbc_set_frozen(ptr);
+  return 1;
+}
+
+
+//================================================================
+/*! apply func to all memory blocks reachable from an object.
+
+  @param  v	target object.
+  @param  func	function for each block. returns 0 to stop descending.
+  @param  arg	argument for func.
+*/
+static void walk_object(mrb_value *v, int (*func)(void *, int), int arg)
+{
+  int i, n;
+
+  switch( v->tt ){
+  case MRB_TT_ARRAY:
+    if( !func(v->array, arg) ) return;
+    n = v->array->i;
+    for( i=1 ; i<=n ; i++ ){
+      walk_object(v->array + i, func, arg);
+    }
+    break;
+
+  case MRB_TT_STRING:
+    func(v->str, arg);
+    break;
+
+  case MRB_TT_HASH: {
+    mrb_hash *h = v->hash;
+    if( !func(h, arg) ) return;
+    func(h->entries, arg);
+    if( h->index ) func(h->index, arg);
+    n = h->used * 2;
+    for( i=0 ; i<n ; i++ ){
+      walk_object(h->entries + i, func, arg);
+    }
+  } break;
+
+  case MRB_TT_RANGE:
+    if( !func(v->range, arg) ) return;
+    walk_object(v->range + 1, func, arg);
+    walk_object(v->range + 2, func, arg);
+    break;
+
+  default:
+    break;
+  }
+}
+
+
+// Internal use only
+// body of mrbc_refers_vm()
+static int refers_vm(const mrb_value *v, int vm_id, int depth)
+{
+  int i, n, ret;
+
+  if( depth > WALK_MAX_DEPTH ) return 2;
+
+  int id = mrbc_owner_vm_id(v);
+  int found = (id > 0 && (vm_id < 0 || id == vm_id));
+
+  switch( v->tt ){
+  case MRB_TT_OBJECT:
+  case MRB_TT_USERTOP:
+  case MRB_TT_CLASS:
+  case MRB_TT_PROC:
+    return found ? 2 : 0;
+
+  case MRB_TT_ARRAY:
+    n = v->array->i;
+    for( i=1 ; i<=n ; i++ ){
+      ret = refers_vm(v->array + i, vm_id, depth+1);
+      if( ret == 2 ) return 2;
+      found |= ret;
+    }
+    break;
+
+  case MRB_TT_HASH:
+    n = v->hash->used * 2;
+    for( i=0 ; i<n ; i++ ){
+      ret = refers_vm(v->hash->entries + i, vm_id, depth+1);
+      if( ret == 2 ) return 2;
+      found |= ret;
+    }
+    break;
+
+  case MRB_TT_RANGE:
+    for( i=1 ; i<=2 ; i++ ){
+      ret = refers_vm(v->range + i, vm_id, depth+1);
+      if( ret == 2 ) return 2;
+      found |= ret;
+    }
+    break;
+
+  default:
+    break;
+  }
+
+  return found;
+}
+
+
+//================================================================
+/*! find memory blocks of a VM, reachable from an object.
+
+  @param  v	target object.
+  @param  vm_id	owner to find. -1 means any VM.
+  @retval 0	not found.
+  @retval 1	found Array, String, Hash or Range only.
+  @retval 2	found Object, Class or Proc, or nested too deep.
+
+  Objects, classes and procs refer to the class table and IREP of
+  their VM, which are released with the VM. So they can't be moved
+  to other VM or frozen, unlike containers and strings. Blocks in the
+  shared area (vm_id 0) are not counted. A cyclic Array or Hash is
+  reported as 2, because it is nested too deep.
+*/
+int mrbc_refers_vm(const mrb_value *v, int vm_id)
+{
+  return refers_vm(v, vm_id, 0);
+}
+
+
+//================================================================
+/*! move the ownership of an object to other VM, without copying.
+
+  @param  vm	new owner VM. NULL means not owned by any VM.
+  @param  v	target object.
+  @retval 0	No error.
+  @retval -1	v is or contains Object, Class or Proc. nothing is moved.
+
+  Re-tags all memory blocks reachable from v, so that mrbc_free_all()
+  of the old owner will not release them. Frozen blocks are shared
+  by all VMs, so they are left in vm_id 0.
+  Objects and procs can't outlive their VM, so v is refused if it
+  refers any of them. See mrbc_refers_vm().
+*/
+int mrbc_transfer(mrb_vm *vm, mrb_value *v)
+{
+  if( mrbc_refers_vm(v, -1) == 2 ) return -1;
+
+  walk_object(v, transfer_block, vm ? vm->vm_id : 0);
+  return 0;
+}
+
+
+//================================================================
+/*! move the memory blocks owned by a VM to other VM.
+
+  @param  from	old owner VM.
+  @param  to	new owner VM. NULL means not owned by any VM.
+  @param  v	target object.
+
+  Unlike mrbc_transfer(), blocks owned by other VMs (or frozen ones)
+  are left as they are.
+*/
+void mrbc_transfer_from(mrb_vm *from, mrb_vm *to, mrb_value *v)
+{
+  walk_object(v, transfer_block_from,
+	      (from->vm_id << 8) | (to ? to->vm_id : 0));
+}
+
+
+//================================================================
+/*! release an object which is not referred from anywhere.
+
+  @param  vm	owner VM.
+  @param  v	target object. it is set to nil.
+
+  There is no GC, so a value dropped by C code before it is stored in
+  a register or a container must be released by its maker.
+  Blocks owned by other VMs, frozen ones, objects, classes and procs
+  are left as they are.
+*/
+void mrbc_release(mrb_vm *vm, mrb_value *v)
+{
+  int i, n;
+
+  if( mrbc_owner_vm_id(v) != vm->vm_id ) goto L_DONE;
+
+  switch( v->tt ){
+  case MRB_TT_ARRAY:
+    n = v->array->i;
+    for( i=1 ; i<=n ; i++ ){
+      mrbc_release(vm, v->array + i);
+    }
+    mrbc_free(vm, v->array);
+    break;
+
+  case MRB_TT_STRING:
+    mrbc_free(vm, v->str);
+    break;
+
+  case MRB_TT_HASH: {
+    mrb_hash *h = v->hash;
+    n = h->used * 2;
+    for( i=0 ; i<n ; i++ ){
+      mrbc_release(vm, h->entries + i);
+    }
+    if( h->index ) mrbc_free(vm, h->index);
+    mrbc_free(vm, h->entries);
+    mrbc_free(vm, h);
+  } break;
+
+  case MRB_TT_RANGE:
+    mrbc_release(vm, v->range + 1);
+    mrbc_release(vm, v->range + 2);
+    mrbc_free(vm, v->range);
+    break;
+
+  default:
+    break;
+  }
+
+ L_DONE:
+  v->tt = MRB_TT_NIL;
+}
+
+
+//================================================================
+/*! get the VM which owns the object.
+
+  @param  v	target object.
+  @return int	vm_id. -1 if immediate value or not in memory pool.
+*/
+int mrbc_owner_vm_id(const mrb_value *v)
+{
+  void *ptr;
+
+  switch( v->tt ){
+  case MRB_TT_ARRAY:	ptr = v->array;	break;
+  case MRB_TT_STRING:	ptr = v->str;	break;
+  case MRB_TT_HASH:	ptr = v->hash;	break;
+  case MRB_TT_RANGE:	ptr = v->range;	break;
+  case MRB_TT_OBJECT:	ptr = v->obj;	break;
+  case MRB_TT_USERTOP:	ptr = v->obj;	break;
+  case MRB_TT_CLASS:	ptr = v->cls;	break;
+  case MRB_TT_PROC:	ptr = v->proc;	break;
+  default:
+    return -1;	// immediate values
+  }
+
+  return mrbc_is_pool_ptr(ptr) ? mrbc_get_vm_id(ptr) : -1;
+}
+
+
+//================================================================
+/*! deep freeze an object.
+
+  @param  v	target object.
+  @retval 0	No error.
+  @retval -1	v contains Object, Class or Proc. nothing is frozen.
+
+  Frozen objects are moved to the shared area, which is never released
+  by mrbc_free_all(), so any VM can read them without copying.
+  Objects and procs are released with their VM, so a container which
+  refers any of them is refused. See mrbc_refers_vm().
+*/
+int mrbc_freeze(mrb_value *v)
+{
+  if( mrbc_refers_vm(v, -1) == 2 ){
+    switch( v->tt ){
+    case MRB_TT_OBJECT:
+    case MRB_TT_USERTOP:
+    case MRB_TT_CLASS:
+    case MRB_TT_PROC:
+      return 0;		// itself. nothing to do.
+    default:
+      return -1;
+    }
+  }
+
+  walk_object(v, freeze_block, 0);
+  return 0;
+}
+
+
+//================================================================
+/*! check the object is frozen.
+
+  @param  v	target object.
+  @return int	1 if frozen.
+*/
+int mrbc_is_frozen_object(mrb_value *v)
+{
+  void *ptr;
+
+  switch( v->tt ){
+  case MRB_TT_ARRAY:	ptr = v->array;	break;
+  case MRB_TT_STRING:	ptr = v->str;	break;
+  case MRB_TT_HASH:	ptr = v->hash;	break;
+  case MRB_TT_RANGE:	ptr = v->range;	break;
+  case MRB_TT_OBJECT:
+  case MRB_TT_CLASS:
+  case MRB_TT_PROC:
+  case MRB_TT_USERTOP:
+    return 0;
+  default:
+    return 1;	// immediate values
+  }
+
+  return mrbc_is_pool_ptr(ptr) ? mrbc_is_frozen(ptr) : 1;
+}
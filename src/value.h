@@ -93,6 +93,7 @@ typedef struct RObject {
     struct RProc *proc;    // MRB_TT_PROC : link to proc
     struct RObject *array; // MRB_TT_ARRAY : array of objects
     struct RObject *range; // MRB_TT_RANGE : link to range
+    struct RHash *hash;    // MRB_TT_HASH : link to hash
     double d;              // MRB_TT_FLOAT : float
     char *str;             // MRB_TT_STRING : C-string
   };
@@ -134,6 +135,20 @@ mrb_proc *mrbc_rproc_alloc_to_class(struct VM *vm, const char *name, mrb_class *
 // EQ two objects
 int mrbc_eq(mrb_value *v1, mrb_value *v2);
 
+// compare two objects
+int mrbc_compare(mrb_value *v1, mrb_value *v2);
+
+// move object to other VM
+int mrbc_transfer(struct VM *vm, mrb_value *v);
+void mrbc_transfer_from(struct VM *from, struct VM *to, mrb_value *v);
+int mrbc_owner_vm_id(const mrb_value *v);
+void mrbc_release(struct VM *vm, mrb_value *v);
+int mrbc_refers_vm(const mrb_value *v, int vm_id);
+
+// freeze object
+int mrbc_freeze(mrb_value *v);
+int mrbc_is_frozen_object(mrb_value *v);
+
 
 // for C call
 #define SET_INT_RETURN(n)         {v[0].tt=MRB_TT_FIXNUM;v[0].i=(n);}
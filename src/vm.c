@@ -25,7 +25,9 @@
 #include "class.h"
 #include "symbol.h"
 #include "console.h"
+#include "snapshot.h"
 
+#include "c_hash.h"
 #include "c_string.h"
 #include "c_range.h"
 
@@ -134,12 +136,7 @@ inline static int op_move( mrb_vm *vm, uint32_t code, mrb_value *regs )
 inline static int op_loadl( mrb_vm *vm, uint32_t code, mrb_value *regs )
 {
   int rb = GETARG_Bx(code);
-  mrb_object *ptr = vm->pc_irep->ptr_to_pool;
-  while( rb > 0 ){
-    ptr = ptr->next;
-    rb--;
-  }
-  regs[GETARG_A(code)] = *ptr;
+  regs[GETARG_A(code)] = *vm->pc_irep->pools[rb];
   return 0;
 }
 
@@ -324,6 +321,12 @@ inline static int op_getconst( mrb_vm *vm, uint32_t code, mrb_value *regs )
   char *sym = find_irep_symbol(vm->pc_irep->ptr_to_sym, rb);
   mrb_sym sym_id = add_sym(sym);
   regs[ra] = const_get(sym_id);
+
+  // classes are registered as global object.
+  if( regs[ra].tt == MRB_TT_FALSE ) {
+    mrb_value v = global_object_get(sym_id);
+    if( v.tt == MRB_TT_CLASS ) regs[ra] = v;
+  }
   return 0;
 }
 
@@ -427,6 +430,11 @@ inline static int op_send( mrb_vm *vm, uint32_t code, mrb_value *regs )
   mrb_sym sym_id = str_to_symid(sym);
   mrb_proc *m = find_method(vm, recv, sym_id);
 
+  // no block given, clear the block slot.
+  if( GET_OPCODE(code) != OP_SENDB ) {
+    regs[GETARG_A(code) + GETARG_C(code) + 1].tt = MRB_TT_NIL;
+  }
+
   if( m == 0 ) {
     console_printf("no method(%s)!\n", sym);
     return 0;
@@ -498,6 +506,13 @@ inline static int op_return( mrb_vm *vm, uint32_t code, mrb_value *regs )
   // return value
   mrb_value v = regs[GETARG_A(code)];
   regs[0] = v;
+
+  // return from top level. (e.g. block running as a task)
+  if( vm->callinfo_top == 0 ) {
+    vm->flag_preemption = 1;
+    return -1;
+  }
+
   // restore irep,pc,regs
   vm->callinfo_top--;
   mrb_callinfo *callinfo = vm->callinfo + vm->callinfo_top;
@@ -934,6 +949,7 @@ inline static int op_array( mrb_vm *vm, uint32_t code, mrb_value *regs )
     // ptr[1..] : array elements
     ptr = (mrb_value*)mrbc_alloc(vm, sizeof(mrb_value)*(arg_c + 1));
     if( ptr == NULL ) return 0;  // ENOMEM
+    mrbc_set_tt(ptr, MRB_TT_ARRAY);
 
     v.obj = ptr;
     ptr->tt = MRB_TT_FIXNUM;
@@ -969,12 +985,7 @@ inline static int op_string( mrb_vm *vm, uint32_t code, mrb_value *regs )
   v.tt = MRB_TT_STRING;
 
   int arg_b = GETARG_Bx(code);
-  mrb_object *ptr = vm->pc_irep->ptr_to_pool;
-  while( arg_b > 0 ){
-    ptr = ptr->next;
-    arg_b--;
-  }
-  v.str = mrbc_string_dup(vm, ptr->str);
+  v.str = mrbc_string_dup(vm, vm->pc_irep->pools[arg_b]->str);
 
   int arg_a = GETARG_A(code);
   regs[arg_a] = v;
@@ -982,6 +993,39 @@ inline static int op_string( mrb_vm *vm, uint32_t code, mrb_value *regs )
 }
 
 
+//================================================================
+/*!@brief
+  Execute STRCAT
+
+  str_cat(R(A),R(B))
+
+  R(A) is appended in place, R(B) is converted as to_s.
+
+  @param  vm    A pointer of VM.
+  @param  code  bytecode
+  @param  regs  vm->regs + vm->reg_top
+  @retval 0  No error.
+*/
+inline static int op_strcat( mrb_vm *vm, uint32_t code, mrb_value *regs )
+{
+#if MRBC_USE_STRING
+  int ra = GETARG_A(code);
+  int rb = GETARG_B(code);
+
+  if( regs[ra].tt != MRB_TT_STRING ) return 0;
+  if( mrbc_is_frozen_object(&regs[ra]) ) {
+    console_printf("FrozenError: can't modify frozen String\n");
+    return 0;
+  }
+
+  char *str = mrbc_string_append(vm, regs[ra].str, &regs[rb]);
+  if( str ) regs[ra].str = str;
+#endif
+
+  return 0;
+}
+
+
 //================================================================
 /*!@brief
   Create HASH object
@@ -999,33 +1043,13 @@ inline static int op_hash( mrb_vm *vm, uint32_t code, mrb_value *regs )
   int arg_b = GETARG_B(code);
   int arg_c = GETARG_C(code);
 
-  mrb_value v; // return value
-  v.tt = MRB_TT_HASH;
-
-  // make handle for hash pair
-  mrb_value *handle = (mrb_value *)mrbc_alloc(vm, sizeof(mrb_value));
-  if( handle == NULL ) return 0;  // ENOMEM
-
-  v.obj = handle;
-  handle->tt = MRB_TT_HANDLE;
-
-  // make hash
-  mrb_value *hash = (mrb_value *)mrbc_alloc(vm, sizeof(mrb_value)*(arg_c*2+1));
-  if( hash == NULL ) return 0;  // ENOMEM
-  handle->obj = hash;
-
-  hash[0].tt = MRB_TT_FIXNUM;
-  hash[0].i = arg_c;
+  mrb_value v = mrbc_hash_new(vm, arg_c);
+  if( v.hash == NULL ) return 0;  // ENOMEM
 
   mrb_value *src = &regs[arg_b];
-  mrb_value *dst = &hash[1];
   while( arg_c > 0 ){
-    // copy key
-    *dst++ = *src++;
-
-    // copy value
-    *dst++ = *src++;
-
+    mrbc_hash_set(vm, &v, src, src+1);
+    src += 2;
     arg_c--;
   }
 
@@ -1180,6 +1204,17 @@ inline static int op_stop( mrb_vm *vm, uint32_t code, mrb_value *regs )
 }
 
 
+//================================================================
+/*!@brief
+  Initialize VM module. all VM ids are released.
+
+*/
+void mrbc_init_vm(void)
+{
+  memset(free_vm_bitmap, 0, sizeof(free_vm_bitmap));
+}
+
+
 //================================================================
 /*!@brief
   Allocate new IREP
@@ -1257,6 +1292,7 @@ void mrbc_vm_close(mrb_vm *vm)
       mrbc_raw_free(obj);
       obj = obj_next;
     }
+    if( irep->pools ) mrbc_raw_free(irep->pools);
     mrb_irep *irep_next = irep->next;
     mrbc_raw_free(irep);
     irep = irep_next;
@@ -1311,12 +1347,14 @@ void mrbc_vm_end(mrb_vm *vm)
 
 //================================================================
 /*!@brief
-  Fetch a bytecode and execute
+  Fetch bytecodes and execute
 
-  @param  vm    A pointer of VM.
+  @param  vm       A pointer of VM.
+  @param  ci_stop  stop when callinfo_top returns to this level,
+                   or -1 to stop at preemption.
   @retval 0  No error.
 */
-int mrbc_vm_run( mrb_vm *vm )
+static int vm_exec( mrb_vm *vm, int ci_stop )
 {
   int ret = 0;
 
@@ -1348,6 +1386,7 @@ int mrbc_vm_run( mrb_vm *vm )
     case OP_JMPIF:      ret = op_jmpif     (vm, code, regs); break;
     case OP_JMPNOT:     ret = op_jmpnot    (vm, code, regs); break;
     case OP_SEND:       ret = op_send      (vm, code, regs); break;
+    case OP_SENDB:      ret = op_send      (vm, code, regs); break;
     case OP_ENTER:      ret = op_enter     (vm, code, regs); break;
     case OP_RETURN:     ret = op_return    (vm, code, regs); break;
     case OP_ADD:        ret = op_add       (vm, code, regs); break;
@@ -1363,6 +1402,7 @@ int mrbc_vm_run( mrb_vm *vm )
     case OP_GE:         ret = op_ge        (vm, code, regs); break;
     case OP_ARRAY:      ret = op_array     (vm, code, regs); break;
     case OP_STRING:     ret = op_string    (vm, code, regs); break;
+    case OP_STRCAT:     ret = op_strcat    (vm, code, regs); break;
     case OP_HASH:       ret = op_hash      (vm, code, regs); break;
     case OP_LAMBDA:     ret = op_lambda    (vm, code, regs); break;
     case OP_RANGE:      ret = op_range     (vm, code, regs); break;
@@ -1374,7 +1414,107 @@ int mrbc_vm_run( mrb_vm *vm )
       console_printf("Skip OP=%02x\n", GET_OPCODE(code));
       break;
     }
-  } while( !vm->flag_preemption );
+    if( ci_stop >= 0 ) {
+      if( vm->callinfo_top <= ci_stop || ret < 0 ) break;
+    } else {
+      if( vm->flag_preemption ) break;
+    }
+  } while( 1 );
+
+  return ret;
+}
+
+
+//================================================================
+/*!@brief
+  Get num of arguments, in the C function called by SEND.
+
+  @param  vm    A pointer of VM.
+  @return       num of arguments.
+*/
+int mrbc_get_argc( mrb_vm *vm )
+{
+  uint32_t code = bin_to_uint32(vm->pc_irep->code + (vm->pc - 1) * 4);
+  return GETARG_C(code);
+}
+
+
+//================================================================
+/*!@brief
+  Fetch a bytecode and execute
+
+  @param  vm    A pointer of VM.
+  @retval 0  No error.
+*/
+int mrbc_vm_run( mrb_vm *vm )
+{
+  return vm_exec(vm, -1);
+}
+
+
+//================================================================
+/*!@brief
+  Call a proc (block) from C function, and wait for return.
+
+  The block runs to completion in a nested loop, because the state of
+  the C function is on the C stack. So the task can't be switched in
+  the block; vm->nested_call is counted up meanwhile, and blocking
+  methods such as sleep and Task#join refuse to run when it is not 0.
 
+  @param  vm    A pointer of VM.
+  @param  regs  register window for the proc. regs[1..argc] are
+                arguments, and the return value is stored in regs[0].
+  @param  proc  target proc.
+  @param  argc  num of arguments.
+  @retval 0  No error.
+*/
+int mrbc_call_proc( mrb_vm *vm, mrb_value *regs, mrb_proc *proc, int argc )
+{
+  // self
+  regs[0] = vm->regs[vm->reg_top];
+
+  if( proc->c_func ) {
+    proc->func.func(vm, regs);
+    return 0;
+  }
+
+  int reg_top = regs - vm->regs;
+  if( reg_top + proc->func.irep->nregs > MAX_REGS_SIZE ||
+      vm->callinfo_top >= MAX_CALLINFO_SIZE ) {
+    console_printf("stack overflow in block call.\n");
+    regs[0].tt = MRB_TT_NIL;
+    return -1;
+  }
+
+  // callinfo
+  mrb_callinfo *callinfo = vm->callinfo + vm->callinfo_top;
+  callinfo->reg_top = vm->reg_top;
+  callinfo->pc_irep = vm->pc_irep;
+  callinfo->pc = vm->pc;
+  callinfo->n_args = argc;
+  int ci_stop = vm->callinfo_top++;
+
+  // target irep
+  vm->pc = 0;
+  vm->pc_irep = proc->func.irep;
+  vm->reg_top = reg_top;
+
+  vm->nested_call++;
+  int ret = vm_exec(vm, ci_stop);
+  vm->nested_call--;
   return ret;
 }
+
+
+//================================================================
+/*!@brief
+  apply func to static variables, for snapshot.
+
+  @param  func	write or read function.
+  @param  arg	user argument.
+  @retval 0	No error.
+*/
+int mrbc_vm_snapshot(mrbc_snapshot_func func, void *arg)
+{
+  return func(free_vm_bitmap, sizeof(free_vm_bitmap), arg);
+}
@@ -34,12 +34,14 @@ typedef struct IREP {
   struct IREP *next; //! irep linked list
 
   uint8_t    *code;
-  mrb_object *ptr_to_pool;
+  mrb_object *ptr_to_pool;  //! pool objects owned by this irep (linked list)
+  mrb_object **pools;       //! pool index, may point other irep's object
   uint8_t    *ptr_to_sym;
 
   int16_t nlocals;
   int16_t nregs;
   int16_t rlen;
+  int16_t plen;
   int32_t ilen;
 
   int16_t iseq;
@@ -82,15 +84,19 @@ typedef struct VM {
   int32_t error_code;
 
   volatile int8_t flag_preemption;
+  uint8_t nested_call;  // nesting of mrbc_call_proc()
 } mrb_vm;
 
 
+void mrbc_init_vm(void);
 mrb_irep *new_irep(mrb_vm *vm);
 mrb_vm *mrbc_vm_open(void);
 void mrbc_vm_close(mrb_vm *vm);
 void mrbc_vm_begin(mrb_vm *vm);
 void mrbc_vm_end(mrb_vm *vm);
 int mrbc_vm_run(mrb_vm *vm);
+int mrbc_call_proc(mrb_vm *vm, mrb_value *regs, mrb_proc *proc, int argc);
+int mrbc_get_argc(mrb_vm *vm);
 
 
 //================================================================
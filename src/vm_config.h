@@ -40,12 +40,12 @@
 #define MAX_CLASS_COUNT 20
 #endif
 
-/* maximum size of symbol table */
+/* size of symbol string chunk. (symbol table grows by this size) */
 #ifndef MAX_SYMBOLS_SIZE
 #define MAX_SYMBOLS_SIZE 400
 #endif
 
-/* maximum number of symbols */
+/* initial number of symbols. (symbol table grows twice as large) */
 #ifndef MAX_SYMBOLS_COUNT
 #define MAX_SYMBOLS_COUNT 200
 #endif
@@ -71,4 +71,9 @@
 /* USE String. Support String class */
 #define MRBC_USE_STRING 1
 
+/* USE Math. Support Math module. Needs Float, and link with -lm */
+#ifndef MRBC_USE_MATH
+#define MRBC_USE_MATH 0
+#endif
+
 #endif
@@ -0,0 +1,201 @@
+/*! @file
+  @brief
+  Hash benchmark for mruby/c.
+
+  <pre>
+  Copyright (C) 2015-2017 Kyushu Institute of Technology.
+  Copyright (C) 2015-2017 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  Measures insert, lookup, delete and iteration of Hash with 10, 100
+  and 1000 keys, and lookup of small Symbol keyed records. Lookup by
+  linear search over the same entries is measured for comparison.
+
+  Usage: hash_bench
+  </pre>
+*/
+
+#include <stdio.h>
+#include <time.h>
+#include "mrubyc.h"
+#include "c_hash.h"
+
+#define MEMORY_SIZE (0xffff)
+static uint8_t memory_pool[MEMORY_SIZE];
+
+#define TOTAL_OPS 1000000
+
+
+static double now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+
+static mrb_value fixnum(int n)
+{
+  mrb_value v;
+  v.tt = MRB_TT_FIXNUM;
+  v.i = n;
+  return v;
+}
+
+
+// lookup by linear search, same as the old Hash.
+static mrb_value *linear_get(mrb_value *hash, mrb_value *key)
+{
+  mrb_hash *h = hash->hash;
+  int i;
+  for( i=0 ; i<h->used ; i++ ){
+    if( mrbc_eq(&h->entries[i*2], key) ) return &h->entries[i*2+1];
+  }
+  return NULL;
+}
+
+
+static void hash_free(mrb_vm *vm, mrb_value *hash)
+{
+  if( hash->hash->index ) mrbc_free(vm, hash->hash->index);
+  mrbc_free(vm, hash->hash->entries);
+  mrbc_free(vm, hash->hash);
+}
+
+
+static void bench(mrb_vm *vm, int n_keys)
+{
+  int repeat = TOTAL_OPS / n_keys;
+  int i, r;
+  double t0, t1;
+  volatile int sum = 0;
+
+  mrb_value hash;
+  mrb_value key, val;
+
+  // insert, into a table created with the final size.
+  double t_insert = 0;
+  for( r=0 ; r<repeat ; r++ ){
+    hash = mrbc_hash_new(vm, n_keys);
+    t0 = now_ns();
+    for( i=0 ; i<n_keys ; i++ ){
+      key = fixnum(i * 7);
+      val = fixnum(i);
+      mrbc_hash_set(vm, &hash, &key, &val);
+    }
+    t_insert += now_ns() - t0;
+    if( r == repeat-1 ) break;
+    hash_free(vm, &hash);
+  }
+  printf("%5d keys  insert %5.1f ns/op", n_keys, t_insert / (repeat * n_keys));
+
+  // lookup
+  t0 = now_ns();
+  for( r=0 ; r<repeat ; r++ ){
+    for( i=0 ; i<n_keys ; i++ ){
+      key = fixnum(i * 7);
+      sum += mrbc_hash_get(&hash, &key)->i;
+    }
+  }
+  t1 = now_ns();
+  printf("  get %7.1f", (t1 - t0) / (repeat * n_keys));
+
+  // lookup, linear search
+  t0 = now_ns();
+  for( r=0 ; r<repeat ; r++ ){
+    for( i=0 ; i<n_keys ; i++ ){
+      key = fixnum(i * 7);
+      sum += linear_get(&hash, &key)->i;
+    }
+  }
+  t1 = now_ns();
+  printf("  linear get %8.1f", (t1 - t0) / (repeat * n_keys));
+
+  // iterate
+  t0 = now_ns();
+  for( r=0 ; r<repeat ; r++ ){
+    mrb_hash *h = hash.hash;
+    for( i=0 ; i<h->used ; i++ ){
+      if( h->entries[i*2].tt != MRB_TT_EMPTY ) sum += h->entries[i*2+1].i;
+    }
+  }
+  t1 = now_ns();
+  printf("  each %5.1f", (t1 - t0) / (repeat * n_keys));
+
+  // delete half, and insert again
+  t0 = now_ns();
+  for( r=0 ; r<repeat ; r++ ){
+    for( i=0 ; i<n_keys ; i+=2 ){
+      key = fixnum(i * 7);
+      mrbc_hash_remove(&hash, &key);
+    }
+    for( i=0 ; i<n_keys ; i+=2 ){
+      key = fixnum(i * 7);
+      mrbc_hash_set(vm, &hash, &key, &key);
+    }
+  }
+  t1 = now_ns();
+  printf("  delete+insert %5.1f ns/op\n", (t1 - t0) / (repeat * n_keys));
+
+  hash_free(vm, &hash);
+}
+
+
+// record style, symbol keys.
+static void bench_record(mrb_vm *vm, int n_keys)
+{
+  int repeat = TOTAL_OPS / n_keys;
+  int i, r;
+  double t0, t1;
+  volatile int sum = 0;
+
+  mrb_value hash = mrbc_hash_new(vm, n_keys);
+  mrb_value key, val;
+  key.tt = MRB_TT_SYMBOL;
+  for( i=0 ; i<n_keys ; i++ ){
+    key.i = 100 + i;
+    val = fixnum(i);
+    mrbc_hash_set(vm, &hash, &key, &val);
+  }
+
+  t0 = now_ns();
+  for( r=0 ; r<repeat ; r++ ){
+    for( i=0 ; i<n_keys ; i++ ){
+      key.i = 100 + i;
+      sum += mrbc_hash_get(&hash, &key)->i;
+    }
+  }
+  t1 = now_ns();
+  printf("%5d syms  get %5.1f ns/op", n_keys, (t1 - t0) / (repeat * n_keys));
+
+  t0 = now_ns();
+  for( r=0 ; r<repeat ; r++ ){
+    for( i=0 ; i<n_keys ; i++ ){
+      key.i = 100 + i;
+      sum += linear_get(&hash, &key)->i;
+    }
+  }
+  t1 = now_ns();
+  printf("  linear get %5.1f ns/op\n", (t1 - t0) / (repeat * n_keys));
+
+  hash_free(vm, &hash);
+}
+
+
+int main(int argc, char *argv[])
+{
+  mrbc_init(memory_pool, MEMORY_SIZE);
+  mrb_vm *vm = mrbc_vm_open();
+  mrbc_vm_begin(vm);
+
+  bench(vm, 10);
+  bench(vm, 100);
+  bench(vm, 1000);
+  bench_record(vm, 4);
+  bench_record(vm, 8);
+
+  mrbc_vm_end(vm);
+  mrbc_vm_close(vm);
+  return 0;
+}
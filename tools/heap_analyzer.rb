@@ -0,0 +1,124 @@
+#
+# mruby/c heap dump analyzer
+#
+#  Reads the output of mrbc_heap_dump() and reports memory usage
+#  by object type and by VM. When two dumps are given, reports the
+#  difference between them.
+#
+#  Usage: heap_analyzer.rb <dump.txt> [<dump2.txt>]
+#
+#  This file is distributed under BSD 3-Clause License.
+#
+
+TYPE_NAME = {
+  -1 => 'HANDLE',
+   0 => '(unknown)',
+   1 => 'TRUE',
+   2 => 'FALSE',
+   3 => 'NIL',
+   4 => 'FIXNUM',
+   5 => 'FLOAT',
+   6 => 'SYMBOL',
+  20 => 'OBJECT',
+  21 => 'CLASS',
+  22 => 'PROC',
+  23 => 'ARRAY',
+  24 => 'STRING',
+  25 => 'RANGE',
+  26 => 'HASH',
+  27 => 'USERTOP',
+}
+
+Block = Struct.new(:offset, :size, :vm_id, :used, :tt)
+
+def load_dump(filename)
+  blocks = []
+  File.foreach(filename) do |line|
+    next if line.start_with?('#')
+    ofs, size, vm_id, flag, tt = line.split
+    next if flag.nil?
+    used = (flag == 'U' || flag == 'R')
+    blocks << Block.new(ofs.hex, size.to_i,
+                        used ? vm_id.to_i : nil, used, used ? tt.to_i : nil)
+  end
+  blocks
+end
+
+def type_name(tt)
+  TYPE_NAME[tt] || "TT(#{tt})"
+end
+
+def summarize(blocks)
+  by_type = Hash.new { |h, k| h[k] = [0, 0] }
+  by_vm   = Hash.new { |h, k| h[k] = [0, 0] }
+  blocks.each do |b|
+    next unless b.used
+    by_type[type_name(b.tt)][0] += 1
+    by_type[type_name(b.tt)][1] += b.size
+    by_vm[b.vm_id][0] += 1
+    by_vm[b.vm_id][1] += b.size
+  end
+  [by_type, by_vm]
+end
+
+def print_table(title, table)
+  puts title
+  table.sort_by { |_, (_, size)| -size }.each do |key, (count, size)|
+    printf("  %-12s %6d blocks %8d bytes\n", key, count, size)
+  end
+end
+
+def report(blocks)
+  used = blocks.select(&:used)
+  free = blocks.reject(&:used)
+  total = blocks.sum(&:size)
+  printf("pool %d bytes, used %d bytes in %d blocks, free %d bytes in %d blocks (largest %d)\n",
+         total, used.sum(&:size), used.size,
+         free.sum(&:size), free.size, free.map(&:size).max || 0)
+
+  by_type, by_vm = summarize(blocks)
+  print_table('by type:', by_type)
+  print_table('by vm_id:', by_vm.map { |k, v| ["vm #{k}", v] })
+end
+
+def print_diff(title, old_table, new_table)
+  puts title
+  (old_table.keys | new_table.keys).each do |key|
+    oc, os = old_table.fetch(key, [0, 0])
+    nc, ns = new_table.fetch(key, [0, 0])
+    next if oc == nc && os == ns
+    printf("  %-12s %+6d blocks %+8d bytes\n", key, nc - oc, ns - os)
+  end
+end
+
+def diff(old_blocks, new_blocks)
+  old_type, old_vm = summarize(old_blocks)
+  new_type, new_vm = summarize(new_blocks)
+  print_diff('by type:', old_type, new_type)
+  print_diff('by vm_id:', old_vm.transform_keys { |k| "vm #{k}" },
+                          new_vm.transform_keys { |k| "vm #{k}" })
+
+  old_set = old_blocks.select(&:used).map(&:to_a)
+  appeared = new_blocks.select { |b| b.used && !old_set.include?(b.to_a) }
+  puts "new blocks: #{appeared.size}"
+  appeared.each do |b|
+    printf("  %05x %5d vm %3d %s\n", b.offset, b.size, b.vm_id, type_name(b.tt))
+  end
+end
+
+
+if ARGV.size < 1 || ARGV.size > 2
+  puts 'Usage: heap_analyzer.rb <dump.txt> [<dump2.txt>]'
+  exit 1
+end
+
+blocks = load_dump(ARGV[0])
+if ARGV.size == 1
+  report(blocks)
+else
+  blocks2 = load_dump(ARGV[1])
+  report(blocks2)
+  puts
+  puts "diff #{ARGV[0]} -> #{ARGV[1]}"
+  diff(blocks, blocks2)
+end
@@ -0,0 +1,211 @@
+/*! @file
+  @brief
+  JSON and MessagePack benchmark for mruby/c.
+
+  <pre>
+  Copyright (C) 2015-2017 Kyushu Institute of Technology.
+  Copyright (C) 2015-2017 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  Measures JSON.generate and JSON.parse in MB/s, on an array of 40
+  sensor records. For comparison, generation by string concatenation
+  is measured, which is what a Ruby level implementation does:
+  every piece makes a new string by mrbc_string_cat(), and the old
+  one is released.
+  MessagePack is measured on the same records; packing into a buffer
+  given by the caller, unpacking to objects, and walking the items
+  with the reader only (no allocation).
+
+  Usage: json_bench
+  </pre>
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "mrubyc.h"
+#include "c_hash.h"
+#include "c_json.h"
+#include "c_msgpack.h"
+#include "c_string.h"
+
+#define MEMORY_SIZE (0xffff)
+static uint8_t memory_pool[MEMORY_SIZE];
+
+#define N_RECORDS 40
+#define REPEAT 2000
+
+
+static double now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+
+// make sample payload, and returns its JSON text.
+static char *make_payload(mrb_vm *vm)
+{
+  char buf[N_RECORDS * 80];
+  int len = 0;
+  int i;
+
+  len += sprintf(buf + len, "[");
+  for( i=0 ; i<N_RECORDS ; i++ ){
+    len += sprintf(buf + len,
+		   "%s{\"id\":%d,\"name\":\"sensor-%d\",\"temp\":%d.%d,\"ok\":%s}",
+		   i ? "," : "", i, i, 20 + i % 10, i % 10,
+		   i % 3 ? "true" : "false");
+  }
+  len += sprintf(buf + len, "]");
+  return mrbc_string_dup(vm, buf);
+}
+
+
+// s + s2, and release s as garbage collector would.
+static char *cat(mrb_vm *vm, char *s, const char *s2)
+{
+  char *ret = mrbc_string_cat(vm, s, s2);
+  mrbc_free(vm, s);
+  return ret;
+}
+
+
+// generate by string concatenation, as a Ruby level implementation.
+static char *concat_generate(mrb_vm *vm, mrb_value *v)
+{
+  char *s = mrbc_string_dup(vm, "[");
+  char num[32];
+  int i, j;
+
+  for( i=1 ; i<=v->array[0].i ; i++ ){
+    mrb_hash *h = v->array[i].hash;
+    s = cat(vm, s, i > 1 ? ",{" : "{");
+    for( j=0 ; j<h->used ; j++ ){
+      mrb_value *key = &h->entries[j*2];
+      mrb_value *val = key + 1;
+      if( j ) s = cat(vm, s, ",");
+      s = cat(vm, s, "\"");
+      s = cat(vm, s, key->str);
+      s = cat(vm, s, "\":");
+      switch( val->tt ){
+      case MRB_TT_FIXNUM: sprintf(num, "%d", val->i); break;
+      case MRB_TT_FLOAT:  sprintf(num, "%.15g", val->d); break;
+      case MRB_TT_TRUE:   strcpy(num, "true"); break;
+      case MRB_TT_FALSE:  strcpy(num, "false"); break;
+      case MRB_TT_STRING: sprintf(num, "\"%s\"", val->str); break;
+      default:            strcpy(num, "null"); break;
+      }
+      s = cat(vm, s, num);
+    }
+    s = cat(vm, s, "}");
+  }
+  return cat(vm, s, "]");
+}
+
+
+// release all objects, and make the payload again.
+static void reset(mrb_vm *vm, char **text, mrb_value *v)
+{
+  mrbc_vm_end(vm);
+  mrbc_vm_begin(vm);
+  *text = make_payload(vm);
+  *v = mrbc_json_parse(vm, *text, strlen(*text));
+}
+
+
+static void report(const char *name, double t, int bytes)
+{
+  printf("%-24s %8.1f us/op %8.2f MB/s\n", name, t / REPEAT / 1000,
+	 (double)bytes * REPEAT / (t / 1e9) / 1e6);
+}
+
+
+int main(int argc, char *argv[])
+{
+  mrbc_init(memory_pool, MEMORY_SIZE);
+  mrb_vm *vm = mrbc_vm_open();
+  mrbc_vm_begin(vm);
+
+  char *text;
+  mrb_value v;
+  double t0, t;
+  int r;
+
+  reset(vm, &text, &v);
+  int len = strlen(text);
+  printf("payload %d bytes, %d records\n", len, N_RECORDS);
+
+  // parse. objects are released after each, for the memory pool.
+  t = 0;
+  for( r=0 ; r<REPEAT ; r++ ){
+    t0 = now_ns();
+    mrbc_json_parse(vm, text, len);
+    t += now_ns() - t0;
+    reset(vm, &text, &v);
+  }
+  report("JSON.parse", t, len);
+
+  // generate.
+  t = 0;
+  for( r=0 ; r<REPEAT ; r++ ){
+    t0 = now_ns();
+    char *s = mrbc_json_generate(vm, &v);
+    t += now_ns() - t0;
+    mrbc_free(vm, s);
+  }
+  report("JSON.generate", t, len);
+
+  // generate by concatenation.
+  t = 0;
+  for( r=0 ; r<REPEAT ; r++ ){
+    t0 = now_ns();
+    concat_generate(vm, &v);
+    t += now_ns() - t0;
+    reset(vm, &text, &v);
+  }
+  report("concat generate", t, len);
+
+  // MessagePack pack, into a fixed buffer.
+  static uint8_t mp_buf[N_RECORDS * 80];
+  mrbc_msgpack_writer w;
+  t = 0;
+  for( r=0 ; r<REPEAT ; r++ ){
+    t0 = now_ns();
+    mrbc_msgpack_writer_init(&w, vm, mp_buf, sizeof(mp_buf));
+    mrbc_msgpack_pack(&w, &v);
+    t += now_ns() - t0;
+  }
+  printf("msgpack %d bytes\n", w.len);
+  report("MessagePack.pack", t, w.len);
+
+  // MessagePack unpack.
+  mrbc_msgpack_reader rd;
+  t = 0;
+  for( r=0 ; r<REPEAT ; r++ ){
+    t0 = now_ns();
+    mrbc_msgpack_reader_init(&rd, mp_buf, w.len);
+    mrbc_msgpack_unpack(vm, &rd);
+    t += now_ns() - t0;
+    reset(vm, &text, &v);
+  }
+  report("MessagePack.unpack", t, w.len);
+
+  // MessagePack read items only.
+  mrbc_msgpack_item item;
+  t = 0;
+  for( r=0 ; r<REPEAT ; r++ ){
+    t0 = now_ns();
+    mrbc_msgpack_reader_init(&rd, mp_buf, w.len);
+    while( mrbc_msgpack_read(&rd, &item) == 0 )
+      ;
+    t += now_ns() - t0;
+  }
+  report("MessagePack read", t, w.len);
+
+  mrbc_vm_end(vm);
+  mrbc_vm_close(vm);
+  return 0;
+}
@@ -0,0 +1,450 @@
+/*! @file
+  @brief
+  Static resource analyzer for mruby/c bytecode.
+
+  <pre>
+  Copyright (C) 2015-2017 Kyushu Institute of Technology.
+  Copyright (C) 2015-2017 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  Loads .mrb files with the mruby/c loader, and reports register,
+  callinfo, symbol, global and literal usage. Prints suggested
+  vm_config.h values.
+
+  Usage: mrubyc_analyze [-c] <xxxx.mrb> [<xxxx.mrb> ...]
+    -c	print only the suggested configuration.
+  Exit status is 2 if recursion is found, and registers and callinfo
+  can't be bounded.
+  </pre>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mrubyc.h"
+#include "opcode.h"
+#include "symbol.h"
+
+#define MEMORY_SIZE (0xffff)
+static uint8_t memory_pool[MEMORY_SIZE];
+
+#define MAX_NAMES 4096
+#define MAX_IREPS 1024
+#define UNBOUNDED (-1)
+#define LAMBDA_REG_SIZE 512
+
+
+//================================================================
+/*! string set.
+*/
+typedef struct NAME_SET {
+  int         n;
+  const char *name[MAX_NAMES];
+} NAME_SET;
+
+static NAME_SET program_syms;	// all symbols in programs
+static NAME_SET global_names;	// $xxx
+static NAME_SET const_names;	// set by SETCONST
+static NAME_SET method_names;	// Ruby methods defined by programs
+static NAME_SET recursive_names; // recursive methods
+
+
+static int name_set_add(NAME_SET *set, const char *name)
+{
+  int i;
+  for( i = 0; i < set->n; i++ ) {
+    if( strcmp(set->name[i], name) == 0 ) return i;
+  }
+  if( set->n >= MAX_NAMES ) return -1;
+  set->name[set->n] = name;
+  return set->n++;
+}
+
+
+//================================================================
+/*! per irep information.
+*/
+typedef struct IREP_INFO {
+  mrb_irep   *irep;
+  const char *method;	// method name, if defined by OP_METHOD.
+  int         nsyms;
+  int         pool_bytes;
+  int         state;	// 0: not visited, 1: visiting, 2: done.
+  int         recursive;
+  int         depth;	// worst callinfo depth from this irep.
+  int         regs;	// worst registers from this irep.
+} IREP_INFO;
+
+static IREP_INFO irep_info[MAX_IREPS];
+static int n_irep_info;
+
+
+//================================================================
+/*! get symbol n in irep.
+*/
+static const char *irep_symbol(mrb_irep *irep, int n)
+{
+  const uint8_t *p = irep->ptr_to_sym;
+  int cnt = bin_to_uint32(p);
+  if( n >= cnt ) return "";
+  p += 4;
+  while( n > 0 ) {
+    p += 2 + bin_to_uint16(p) + 1;
+    n--;
+  }
+  return (const char *)p + 2;
+}
+
+
+//================================================================
+/*! get irep index set by OP_LAMBDA to register n.
+
+  @return	irep index, or -1 if none or n is out of range.
+*/
+static int lambda_target(const int *lambda_reg, int n)
+{
+  if( n < 0 || n >= LAMBDA_REG_SIZE ) return -1;
+  return lambda_reg[n];
+}
+
+
+static int is_send_op(int op)
+{
+  switch( op ) {
+  case OP_SEND: case OP_SENDB:
+  case OP_ADD: case OP_ADDI: case OP_SUB: case OP_SUBI:
+  case OP_MUL: case OP_DIV:
+  case OP_EQ: case OP_LT: case OP_LE: case OP_GT: case OP_GE:
+    return 1;
+  }
+  return 0;
+}
+
+
+//================================================================
+/*! collect information from one program.
+
+  @param  first	index of top irep of this program in irep_info.
+*/
+static void scan_program(int first)
+{
+  int i;
+
+  for( i = first; i < n_irep_info; i++ ) {
+    mrb_irep *irep = irep_info[i].irep;
+    int lambda_reg[LAMBDA_REG_SIZE];	// register -> irep index, by OP_LAMBDA
+    mrb_object *obj;
+    int j;
+
+    memset(lambda_reg, 0xff, sizeof(lambda_reg));
+
+    irep_info[i].nsyms = bin_to_uint32(irep->ptr_to_sym);
+    for( j = 0; j < irep_info[i].nsyms; j++ ) {
+      name_set_add(&program_syms, irep_symbol(irep, j));
+    }
+    // count only objects owned by this irep. pools[] may point
+    // objects shared with other ireps.
+    for( obj = irep->ptr_to_pool; obj != NULL; obj = obj->next ) {
+      if( obj->tt == MRB_TT_STRING ) {
+        irep_info[i].pool_bytes += strlen(obj->str) + 1;
+      }
+      irep_info[i].pool_bytes += sizeof(mrb_object);
+    }
+
+    for( j = 0; j < irep->ilen; j++ ) {
+      uint32_t code = bin_to_uint32(irep->code + j * 4);
+      int op = GET_OPCODE(code);
+
+      switch( op ) {
+      case OP_GETGLOBAL:
+      case OP_SETGLOBAL:
+        name_set_add(&global_names, irep_symbol(irep, GETARG_Bx(code)));
+        break;
+
+      case OP_SETCONST:
+        name_set_add(&const_names, irep_symbol(irep, GETARG_Bx(code)));
+        break;
+
+      case OP_LAMBDA:
+        // same as op_lambda(): index from top irep.
+        lambda_reg[GETARG_A(code)] = first + GETARG_b(code) + 1;
+        break;
+
+      case OP_METHOD: {
+        int target = lambda_target(lambda_reg, GETARG_A(code) + 1);
+        if( target > first && target < n_irep_info ) {
+          irep_info[target].method = irep_symbol(irep, GETARG_B(code));
+          name_set_add(&method_names, irep_info[target].method);
+        }
+      } break;
+
+      default:
+        break;
+      }
+    }
+  }
+}
+
+
+//================================================================
+/*! calculate worst callinfo depth and registers, by DFS.
+*/
+static void analyze_irep(int first, int idx)
+{
+  IREP_INFO *info = &irep_info[idx];
+  mrb_irep *irep = info->irep;
+  int lambda_reg[LAMBDA_REG_SIZE];
+  int j, k;
+
+  if( info->state == 2 ) return;
+  if( info->state == 1 ) {
+    info->recursive = 1;
+    return;
+  }
+  info->state = 1;
+  info->depth = 0;
+  info->regs  = irep->nregs;
+  memset(lambda_reg, 0xff, sizeof(lambda_reg));
+
+  for( j = 0; j < irep->ilen; j++ ) {
+    uint32_t code = bin_to_uint32(irep->code + j * 4);
+    int op = GET_OPCODE(code);
+    int a  = GETARG_A(code);
+
+    if( op == OP_LAMBDA ) {
+      lambda_reg[a] = first + GETARG_b(code) + 1;
+      continue;
+    }
+    if( !is_send_op(op) ) continue;
+
+    const char *name = irep_symbol(irep, GETARG_B(code));
+    for( k = first; k < n_irep_info; k++ ) {
+      int callee = -1;
+      if( irep_info[k].method && strcmp(irep_info[k].method, name) == 0 ) {
+        callee = k;
+      } else if( op == OP_SENDB &&
+                 k == lambda_target(lambda_reg, a + GETARG_C(code) + 1) ) {
+        callee = k;	// block called from the method.
+      }
+      if( callee < 0 ) continue;
+
+      analyze_irep(first, callee);
+      IREP_INFO *ci = &irep_info[callee];
+      if( ci->state == 1 || ci->recursive || ci->depth == UNBOUNDED ) {
+        info->recursive = info->recursive || ci->state == 1;
+        info->depth = UNBOUNDED;
+        info->regs  = UNBOUNDED;
+        continue;
+      }
+      if( info->depth != UNBOUNDED && info->depth < ci->depth + 1 ) {
+        info->depth = ci->depth + 1;
+      }
+      if( info->regs != UNBOUNDED && info->regs < a + ci->regs ) {
+        info->regs = a + ci->regs;
+      }
+    }
+  }
+
+  info->state = 2;
+}
+
+
+//================================================================
+/*! load a .mrb file.
+*/
+static uint8_t *load_mrb_file(const char *filename)
+{
+  FILE *fp = fopen(filename, "rb");
+  if( fp == NULL ) {
+    fprintf(stderr, "File not found: %s\n", filename);
+    return NULL;
+  }
+
+  fseek(fp, 0, SEEK_END);
+  size_t size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+
+  uint8_t *p = malloc(size);
+  if( p == NULL ) {
+    fprintf(stderr, "Memory allocate error.\n");
+    fclose(fp);
+    return NULL;
+  }
+  if( fread(p, sizeof(uint8_t), size, fp) != size ) {
+    fprintf(stderr, "Read error: %s\n", filename);
+    free(p);
+    p = NULL;
+  }
+  fclose(fp);
+
+  return p;
+}
+
+
+static int round_up(int n, int unit)
+{
+  return (n + unit - 1) / unit * unit;
+}
+
+
+int main(int argc, char *argv[])
+{
+  int flag_config_only = 0;
+  int argi = 1;
+  int max_regs = 0, max_depth = 0, n_vm = 0;
+  int flag_unbounded = 0;
+  int recursive_regs = 0;	// registers per call of recursive methods
+  int pool_bytes = 0;
+
+  if( argc > 1 && strcmp(argv[1], "-c") == 0 ) {
+    flag_config_only = 1;
+    argi++;
+  }
+  if( argi >= argc ) {
+    printf("Usage: %s [-c] <xxxx.mrb> [<xxxx.mrb> ...]\n", argv[0]);
+    return 1;
+  }
+
+  mrbc_init_alloc(memory_pool, MEMORY_SIZE);
+  init_static();
+
+  // count builtin symbols and globals (classes).
+  int builtin_syms = 0, builtin_sym_bytes = 0, builtin_globals = 0;
+  const char *s;
+  while( (s = symid_to_str(builtin_syms)) != NULL ) {
+    builtin_sym_bytes += strlen(s) + 1;
+    builtin_syms++;
+  }
+  int i;
+  for( i = 0; i < MAX_GLOBAL_OBJECT_SIZE; i++ ) {
+    if( mrbc_global[i].sym_id >= 0 ) builtin_globals++;
+  }
+
+  for( ; argi < argc; argi++ ) {
+    uint8_t *mrb = load_mrb_file(argv[argi]);
+    if( mrb == NULL ) return 1;
+
+    mrb_vm *vm = mrbc_vm_open();
+    if( vm == NULL ) {
+      fprintf(stderr, "Error: Can't open VM.\n");
+      return 1;
+    }
+    if( mrbc_load_mrb(vm, mrb) != 0 ) {
+      fprintf(stderr, "Error: Illegal bytecode. %s\n", argv[argi]);
+      return 1;
+    }
+    n_vm++;
+
+    int first = n_irep_info;
+    mrb_irep *irep;
+    for( irep = vm->irep; irep != NULL; irep = irep->next ) {
+      if( n_irep_info >= MAX_IREPS ) {
+        fprintf(stderr, "Error: Too many ireps.\n");
+        return 1;
+      }
+      irep_info[n_irep_info++].irep = irep;
+    }
+    scan_program(first);
+    analyze_irep(first, first);
+
+    if( !flag_config_only ) {
+      printf("%s\n", argv[argi]);
+      printf("  irep nlocals nregs  ilen  plen  syms  depth  regs  method\n");
+    }
+    for( i = first; i < n_irep_info; i++ ) {
+      IREP_INFO *info = &irep_info[i];
+      analyze_irep(first, i);	// not reached from top.
+      pool_bytes += info->pool_bytes;
+      if( info->recursive ) {
+        name_set_add(&recursive_names, info->method ? info->method : "(block)");
+        if( recursive_regs < info->irep->nregs ) {
+          recursive_regs = info->irep->nregs;
+        }
+      }
+      if( flag_config_only ) continue;
+
+      printf("  %4d %7d %5d %5d %5d %5d ", i - first, info->irep->nlocals,
+             info->irep->nregs, (int)info->irep->ilen, info->irep->plen,
+             info->nsyms);
+      if( info->depth == UNBOUNDED ) {
+        printf("    -     -  ");
+      } else {
+        printf("%6d %5d  ", info->depth, info->regs);
+      }
+      printf("%s%s\n", info->method ? info->method : (i == first ? "(top)" : ""),
+             info->recursive ? " (recursive)" : "");
+    }
+
+    IREP_INFO *top = &irep_info[first];
+    if( top->depth == UNBOUNDED ) {
+      flag_unbounded = 1;
+    } else {
+      if( max_depth < top->depth ) max_depth = top->depth;
+      if( max_regs < top->regs ) max_regs = top->regs;
+    }
+  }
+
+  int sym_bytes = builtin_sym_bytes;
+  for( i = 0; i < program_syms.n; i++ ) {
+    if( str_to_symid(program_syms.name[i]) < 0 ) {
+      sym_bytes += strlen(program_syms.name[i]) + 1;
+    }
+  }
+  int n_syms = builtin_syms;
+  for( i = 0; i < program_syms.n; i++ ) {
+    if( str_to_symid(program_syms.name[i]) < 0 ) n_syms++;
+  }
+  // each VM defines class UserTop.
+  int n_globals = builtin_globals + global_names.n + (n_vm > 0 ? 1 : 0);
+
+  // names of recursive methods, for messages.
+  char recursive_list[256] = "";
+  for( i = 0; i < recursive_names.n; i++ ) {
+    int len = strlen(recursive_list);
+    snprintf(recursive_list + len, sizeof(recursive_list) - len, "%s%s",
+             i ? ", " : "", recursive_names.name[i]);
+  }
+
+  if( !flag_config_only ) {
+    printf("\n");
+    if( flag_unbounded ) {
+      printf("worst callinfo depth : unknown (recursion in %s,"
+             " 1 per call)\n", recursive_list);
+      printf("worst registers      : unknown (recursion in %s,"
+             " %d per call)\n", recursive_list, recursive_regs);
+    } else {
+      printf("worst callinfo depth : %d\n", max_depth);
+      printf("worst registers      : %d\n", max_regs);
+    }
+    printf("symbols              : %d (%d bytes), builtin %d (%d bytes)\n",
+           n_syms, sym_bytes, builtin_syms, builtin_sym_bytes);
+    printf("globals              : %d, builtin classes %d\n",
+           global_names.n, builtin_globals);
+    for( i = 0; i < global_names.n; i++ ) {
+      printf("  %s\n", global_names.name[i]);
+    }
+    printf("constants            : %d\n", const_names.n);
+    for( i = 0; i < const_names.n; i++ ) {
+      printf("  %s\n", const_names.name[i]);
+    }
+    printf("literal pool         : %d bytes\n", pool_bytes);
+    printf("\n/* suggested vm_config.h */\n");
+  }
+
+  printf("#define MAX_VM_COUNT %d\n", n_vm);
+  if( flag_unbounded ) {
+    printf("/* recursion found in %s: MAX_REGS_SIZE and MAX_CALLINFO_SIZE\n"
+           "   are unknown. Each call needs 1 callinfo and %d registers. */\n",
+           recursive_list, recursive_regs);
+  } else {
+    printf("#define MAX_REGS_SIZE %d\n", max_regs + 1);
+    printf("#define MAX_CALLINFO_SIZE %d\n", max_depth + 1);
+  }
+  printf("#define MAX_SYMBOLS_COUNT %d\n", n_syms);
+  printf("#define MAX_SYMBOLS_SIZE %d\n", round_up(sym_bytes, 4));
+  printf("#define MAX_GLOBAL_OBJECT_SIZE %d\n", n_globals);
+  printf("#define MAX_CONST_COUNT %d\n", const_names.n > 0 ? const_names.n : 1);
+
+  return flag_unbounded ? 2 : 0;
+}